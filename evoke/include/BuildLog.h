@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+// Append-only history of the commands evoke has run, keyed by a hash of the command line.
+class BuildLog {
+public:
+  struct Entry {
+    uint64_t commandHash;
+    // Wall clock, in microseconds since the epoch.
+    int64_t startUs;
+    int64_t endUs;
+    int32_t exitCode;
+    uint32_t reserved;
+    uint64_t userUs;
+    uint64_t systemUs;
+    uint64_t maxRssKb;
+    uint64_t DurationUs() const { return endUs > startUs ? endUs - startUs : 0; }
+  };
+  BuildLog() = default;
+  ~BuildLog();
+  BuildLog(const BuildLog&) = delete;
+  BuildLog& operator=(const BuildLog&) = delete;
+  void Load(const std::string& filename);
+  void Record(const Entry& entry);
+  // The most recent successful run of the command, or failing that its most recent run.
+  const Entry* Find(uint64_t commandHash) const;
+private:
+  void Remember(const Entry& entry);
+  void Rewrite(const std::string& filename);
+  std::unordered_map<uint64_t, Entry> entries;
+  int fd = -1;
+};
+
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+class ObjectCache;
+class Project;
+struct Component;
+
+// Whole-archive shortcut for third-party libraries under packages/. A component's key covers the
+// contents of its files and of every component it reaches, and its command lines. When the archive
+// on disk was made for that key, or one can be restored from the object cache, all of the
+// component's commands are marked done without checking a single one of them.
+class ComponentCache {
+public:
+  ComponentCache(Project& project, ObjectCache& cache);
+  // Call after the commands are created and before they are checked.
+  void Restore();
+  // Call after the build; stores the archives of the packages that were built or checked.
+  void Store();
+  void PrintStatistics();
+private:
+  uint64_t Key(Component& component);
+  uint64_t Digest(Component& component);
+  Project& project;
+  ObjectCache& cache;
+  std::unordered_map<Component*, uint64_t> digests;
+  // Packages that went through the regular checks, with their keys.
+  std::unordered_map<Component*, uint64_t> pending;
+  size_t current = 0, restored = 0, stored = 0;
+};
+
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+class Project;
+
+// Keeps the project loaded, watches the tree with inotify and runs build() for every client request.
+int RunDaemon(Project& project, std::function<int()> build);
+
+// Sends a single command ("build" or "stop") to a running daemon and relays its output.
+int RunClient(const std::string& command);
+
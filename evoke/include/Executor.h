@@ -2,9 +2,17 @@
 
 #include <string>
 #include <vector>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <unordered_map>
 #include <functional>
 #include <mutex>
+#include <thread>
 
+class BuildLog;
+class ObjectCache;
+struct File;
 struct PendingCommand;
 
 class Task {
@@ -19,18 +27,84 @@ public:
   std::vector<char> outbuffer;
 };
 
+struct Process;
+
+// Runs commands as child processes. A single event loop thread collects their output and exit
+// status through epoll and dispatches the next commands as earlier ones complete.
 class Executor {
 public:
-  Executor();
+  // Runs up to jobs commands at once. In adaptive mode the limit moves between 1 and twice that,
+  // following CPU and memory pressure on the host. With a memory budget, commands only start when
+  // their expected peak RSS fits next to that of the commands already running. Cacheable commands
+  // are looked up in the cache, if there is one, before they are run. Lookups in a remote cache,
+  // and hashing the outputs of finished commands, happen on worker threads outside the lock, so
+  // they hold up neither the event loop nor the other slots.
+  Executor(BuildLog& log, ObjectCache* cache, size_t jobs, bool adaptive, uint64_t memoryBudgetKb = 0);
   ~Executor();
   void Run(PendingCommand* cmd);
   void Start();
-  bool Busy();
+  // Blocks until nothing is running and nothing else can be started.
+  void Wait();
 private:
   void RunMoreCommands();
+  void EventLoop();
+  void Watch(Process* process);
+  void OnComplete(Process* process);
+  // Runs on a worker once c has finished or was taken from the cache: stores its output in the
+  // cache under storeKey unless that is 0, hashes its outputs, records the result and releases its
+  // consumers.
+  void Finish(PendingCommand* c, bool success, uint64_t storeKey = 0);
+  // Called with m held once c's outputs are built. Adds the consumers that c was the last input
+  // for to unblocked.
+  void Release(PendingCommand* c, std::vector<PendingCommand*>& unblocked);
+  // Called without m. Skips the unblocked commands whose inputs came out the same as last time,
+  // which may unblock more, and makes the others ready.
+  void Settle(std::vector<PendingCommand*>& unblocked);
+  // Called with m held. The job runs on a worker without it; RunMoreCommands follows it.
+  void Queue(std::function<void()> job);
+  void Work();
+  uint64_t EstimateDuration(PendingCommand* cmd);
+  uint64_t EstimateRss(PendingCommand* cmd);
+  PendingCommand* TakeReadyCommand(size_t active);
+  uint64_t CriticalPath(PendingCommand* cmd);
+  uint64_t EstimateRemaining();
+  void Adapt();
+  BuildLog& log;
+  ObjectCache* cache;
   std::mutex m;
-  std::vector<PendingCommand*> commands;
+  std::condition_variable idle;
+  bool finished = false;
+  // Set by Start. Until then commands are still being registered and ready is not a heap yet.
+  bool started = false;
+  // Heap of commands whose inputs are all built, longest critical path first.
+  std::vector<PendingCommand*> ready;
+  // Ready commands that did not fit in the memory budget when their turn came, longest critical
+  // path first. They wait here, out of the heap, until they fit.
+  std::vector<PendingCommand*> deferred;
+  size_t heldBack = 0;
+  std::vector<PendingCommand*> registered;
+  std::unordered_map<PendingCommand*, bool> visiting;
+  size_t remaining = 0;
+  size_t skipped = 0;
+  uint64_t remainingWork = 0;
   std::vector<Task*> activeTasks;
+  size_t slots;
+  bool adaptive;
+  size_t cpus;
+  uint64_t memoryBudgetKb;
+  uint64_t memoryInUseKb = 0;
+  std::chrono::steady_clock::time_point lastAdapted;
+  int epollFd;
+  int wakeFd;
+  bool stopping = false;
+  std::thread loop;
+  // Jobs for the workers, and how many are queued or running; those can still make commands ready.
+  std::deque<std::function<void()>> jobs;
+  size_t pendingJobs = 0;
+  std::condition_variable jobQueued;
+  std::vector<std::thread> workers;
+  // Keys of commands that missed in the remote cache and are back in ready to be run.
+  std::unordered_map<PendingCommand*, uint64_t> lookedUp;
 };
 
 
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+class RemoteCache;
+
+// Outputs of earlier compiles, kept in a directory and keyed by the compile command and the contents
+// of everything it reads. Lets a branch switch reuse objects built under another checkout state.
+class ObjectCache {
+public:
+  // maxBytes is a soft limit; Trim evicts the least recently used entries down to it. With a
+  // remote URL, entries missing here are looked for there and new ones are shared with it.
+  ObjectCache(const std::string& dir, uint64_t maxBytes, const std::string& remoteUrl = "");
+  ~ObjectCache();
+  // Key for a command whose inputs hash to inputsDigest. Also covers the compiler binary itself,
+  // so an upgraded compiler does not reuse old objects.
+  uint64_t Key(const std::string& command, uint64_t inputsDigest);
+  // Puts the entry for key at path, by reflink, hardlink or copy. False on a miss.
+  bool Fetch(uint64_t key, const std::string& path);
+  // Fetch split in two, so that the network round trip can be left to another thread. FetchLocal
+  // only counts a miss when there is no remote cache to ask next. FetchRemote and Store are thread
+  // safe.
+  bool FetchLocal(uint64_t key, const std::string& path);
+  bool FetchRemote(uint64_t key, const std::string& path);
+  bool HasRemote() const { return remote != nullptr; }
+  void Store(uint64_t key, const std::string& path);
+  void Trim();
+  void PrintStatistics();
+  static std::string EntryPath(const std::string& dir, uint64_t key);
+private:
+  bool Materialise(const std::string& entry, const std::string& path);
+  bool Download(uint64_t key, const std::string& entry);
+  uint64_t ToolHash(const std::string& program);
+  std::string dir;
+  uint64_t maxBytes;
+  std::unordered_map<std::string, uint64_t> toolHashes;
+  std::unique_ptr<RemoteCache> remote;
+  std::atomic<size_t> hits{0}, misses{0}, stores{0};
+  std::atomic<uint64_t> bytesStored{0};
+  uint64_t bytesInCache = 0, bytesEvicted = 0;
+};
+
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Object cache entries shared over HTTP: GET and PUT of <url>/<key as 16 hex digits>. Anything
+// that serves files that way will do, such as RunCacheServer below.
+class RemoteCache {
+public:
+  // Only plain http:// URLs are supported.
+  RemoteCache(const std::string& url);
+  // Waits for queued uploads to finish.
+  ~RemoteCache();
+  bool Valid() const { return !host.empty(); }
+  bool Get(uint64_t key, std::vector<char>& data);
+  // Queues the file for upload and returns straight away; a background thread sends it.
+  void Put(uint64_t key, const std::string& path);
+  void PrintStatistics();
+private:
+  bool Request(const std::string& method, uint64_t key, const std::vector<char>& body, int& status, std::vector<char>& response);
+  void Upload();
+  std::string host, port, prefix;
+  std::mutex m;
+  std::condition_variable queued;
+  std::deque<std::pair<uint64_t, std::string>> uploads;
+  bool stopping = false;
+  bool uploading = false;
+  // Cleared when the server cannot be reached, so a server that is down costs one timeout per build.
+  bool available = true;
+  size_t hits = 0, misses = 0, uploaded = 0, failures = 0;
+  std::thread uploader;
+};
+
+// Serves GET and PUT of cache entries from dir, laid out like the local object cache. Listens on
+// [address:]port, on localhost unless an address is given.
+int RunCacheServer(const std::string& listenOn, const std::string& dir);
+
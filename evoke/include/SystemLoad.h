@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Number of CPUs this process may run on: its affinity mask, capped by any cgroup v2 cpu.max quota
+// on the way up from its own cgroup.
+size_t AvailableCpus();
+
+// Physical memory this process may use in KB: MemTotal, capped by any cgroup v2 memory.max.
+uint64_t AvailableMemoryKb();
+
+struct SystemLoad {
+  // Share of the last 10 seconds in which some task stalled on CPU or memory, in percent.
+  double cpuPressure = 0;
+  double memoryPressure = 0;
+  double loadAverage = 0;
+  bool hasPressure = false;
+};
+
+// Reads /proc/pressure (where the kernel provides it) and /proc/loadavg.
+SystemLoad ReadSystemLoad();
+
@@ -0,0 +1,92 @@
+#include "BuildLog.h"
+#include <boost/filesystem.hpp>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+
+// Layout: magic, then fixed size records. A torn record at the end is cut off on load.
+static const char magic[8] = { 'E', 'V', 'K', 'L', 'O', 'G', '0', '2' };
+
+BuildLog::~BuildLog() {
+  if (fd >= 0) close(fd);
+}
+
+void BuildLog::Load(const std::string& filename) {
+  if (fd >= 0) close(fd);
+  entries.clear();
+  boost::system::error_code ec;
+  boost::filesystem::create_directories(boost::filesystem::path(filename).parent_path(), ec);
+  fd = open(filename.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "Cannot open build log %s: %s\n", filename.c_str(), strerror(errno));
+    return;
+  }
+  std::vector<char> contents;
+  char buffer[65536];
+  ssize_t bread;
+  while ((bread = read(fd, buffer, sizeof(buffer))) > 0 || (bread < 0 && errno == EINTR)) {
+    if (bread > 0) contents.insert(contents.end(), buffer, buffer + bread);
+  }
+  if (contents.size() < sizeof(magic) || memcmp(contents.data(), magic, sizeof(magic)) != 0) {
+    // Logs from an older version of the format are dropped without complaint; they only hold timings.
+    bool olderVersion = contents.size() >= sizeof(magic) && memcmp(contents.data(), magic, sizeof(magic) - 1) == 0;
+    if (!contents.empty() && !olderVersion) fprintf(stderr, "Build log %s has an unknown format, starting a new one\n", filename.c_str());
+    Rewrite(filename);
+    return;
+  }
+  size_t count = (contents.size() - sizeof(magic)) / sizeof(Entry);
+  for (size_t n = 0; n < count; n++) {
+    Entry entry;
+    memcpy(&entry, contents.data() + sizeof(magic) + n * sizeof(Entry), sizeof(entry));
+    Remember(entry);
+  }
+  // Superseded records only cost space; drop them once they are the majority.
+  if (count > 1024 && count > 2 * entries.size()) {
+    Rewrite(filename);
+  } else if (sizeof(magic) + count * sizeof(Entry) != contents.size()) {
+    if (ftruncate(fd, sizeof(magic) + count * sizeof(Entry)) != 0) Rewrite(filename);
+  }
+}
+
+void BuildLog::Rewrite(const std::string& filename) {
+  std::string tmpname = filename + ".tmp";
+  int out = open(tmpname.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (out < 0) {
+    fprintf(stderr, "Cannot write build log %s: %s\n", tmpname.c_str(), strerror(errno));
+    return;
+  }
+  std::vector<char> contents(magic, magic + sizeof(magic));
+  for (auto& e : entries) {
+    contents.insert(contents.end(), reinterpret_cast<const char*>(&e.second), reinterpret_cast<const char*>(&e.second + 1));
+  }
+  bool ok = write(out, contents.data(), contents.size()) == static_cast<ssize_t>(contents.size());
+  close(out);
+  if (!ok || rename(tmpname.c_str(), filename.c_str()) != 0) {
+    fprintf(stderr, "Cannot write build log %s: %s\n", filename.c_str(), strerror(errno));
+    unlink(tmpname.c_str());
+    return;
+  }
+  if (fd >= 0) close(fd);
+  fd = open(filename.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+}
+
+void BuildLog::Remember(const Entry& entry) {
+  // A failed run says little about how long a successful one takes, so it does not replace one.
+  auto it = entries.find(entry.commandHash);
+  if (it == entries.end()) entries.emplace(entry.commandHash, entry);
+  else if (entry.exitCode == 0 || it->second.exitCode != 0) it->second = entry;
+}
+
+void BuildLog::Record(const Entry& entry) {
+  Remember(entry);
+  if (fd < 0) return;
+  if (write(fd, &entry, sizeof(entry)) != sizeof(entry)) {
+    fprintf(stderr, "Cannot append to build log: %s\n", strerror(errno));
+  }
+}
+
+const BuildLog::Entry* BuildLog::Find(uint64_t commandHash) const {
+  auto it = entries.find(commandHash);
+  return it == entries.end() ? nullptr : &it->second;
+}
@@ -0,0 +1,112 @@
+#include "ComponentCache.h"
+#include "BuildManifest.h"
+#include "Component.h"
+#include "File.h"
+#include "Hash.h"
+#include "ObjectCache.h"
+#include "PendingCommand.h"
+#include "Project.h"
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <cstdio>
+
+// Toolsets create a library's archive command last, after the compiles feeding it.
+static File* ArchiveOf(Component& component) {
+  if (component.type != "library" || *component.root.begin() != "packages" || component.commands.empty()) return nullptr;
+  PendingCommand* archive = component.commands.back();
+  return archive->outputs.size() == 1 ? archive->outputs[0] : nullptr;
+}
+
+ComponentCache::ComponentCache(Project& project, ObjectCache& cache)
+: project(project)
+, cache(cache)
+{
+}
+
+void ComponentCache::Restore() {
+  for (auto& p : project.components) {
+    Component& component = p.second;
+    File* archive = ArchiveOf(component);
+    if (!archive) continue;
+    uint64_t key = Key(component);
+    std::string path = archive->path.generic_string();
+    const BuildManifest::Output* recorded = project.manifest.Find(path);
+    if (recorded && recorded->componentKey == key && archive->lastwrite() != 0) {
+      current++;
+    } else {
+      boost::system::error_code ec;
+      boost::filesystem::create_directories(archive->path.parent_path(), ec);
+      if (!cache.Fetch(key, archive->path.string())) {
+        pending[&component] = key;
+        continue;
+      }
+      BuildManifest::Output& output = project.manifest.Get(path);
+      output = BuildManifest::Output();
+      output.commandHash = component.commands.back()->commandHash;
+      archive->Invalidate();
+      output.outputHash = project.manifest.ContentHash(path, archive->lastwrite(), archive->size);
+      output.componentKey = key;
+      restored++;
+    }
+    for (auto& pc : component.commands) {
+      pc->state = PendingCommand::Done;
+      for (auto& o : pc->outputs) o->state = File::Done;
+    }
+  }
+}
+
+void ComponentCache::Store() {
+  for (auto& p : pending) {
+    Component& component = *p.first;
+    bool built = true;
+    for (auto& pc : component.commands) {
+      if (pc->state != PendingCommand::Done) built = false;
+      for (auto& o : pc->outputs) {
+        if (o->state == File::Error) built = false;
+      }
+    }
+    if (!built) continue;
+    File* archive = ArchiveOf(component);
+    cache.Store(p.second, archive->path.string());
+    project.manifest.Get(archive->path.generic_string()).componentKey = p.second;
+    stored++;
+  }
+  pending.clear();
+}
+
+void ComponentCache::PrintStatistics() {
+  if (current + restored + stored == 0) return;
+  printf("Component cache: %zu packages current, %zu restored, %zu stored\n", current, restored, stored);
+}
+
+uint64_t ComponentCache::Key(Component& component) {
+  // Headers of every component this one reaches can end up in its objects.
+  std::vector<uint64_t> parts = { Digest(component) };
+  for (auto& group : GetTransitiveAllDeps(component)) {
+    for (Component* dep : group) {
+      if (dep != &component) parts.push_back(Digest(*dep));
+    }
+  }
+  std::sort(parts.begin() + 1, parts.end());
+  uint64_t key = Xxh64(parts.data(), parts.size() * sizeof(uint64_t));
+  // The command lines carry the flags; Key adds the identity of each tool they run.
+  for (auto& pc : component.commands) {
+    key = cache.Key(pc->commandToRun, key);
+  }
+  return key;
+}
+
+uint64_t ComponentCache::Digest(Component& component) {
+  auto it = digests.find(&component);
+  if (it != digests.end()) return it->second;
+  std::vector<uint64_t> hashes;
+  for (File* f : component.files) {
+    std::string path = f->path.generic_string();
+    uint64_t contents = project.manifest.ContentHash(path, f->lastwrite(), f->size);
+    hashes.push_back(Xxh64(&contents, sizeof(contents), Fnv1a(path)));
+  }
+  std::sort(hashes.begin(), hashes.end());
+  uint64_t digest = Xxh64(hashes.data(), hashes.size() * sizeof(uint64_t));
+  digests[&component] = digest;
+  return digest;
+}
@@ -0,0 +1,262 @@
+#include "Daemon.h"
+#include "DirectoryWalker.h"
+#include "Project.h"
+#include <csignal>
+#include <cstring>
+#include <poll.h>
+#include <set>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const char* socketPath = ".evoke/daemon.sock";
+
+namespace {
+
+struct Changes {
+  std::set<std::string> touched;
+  std::set<std::string> newComponents;
+  bool structural = false;
+};
+
+struct Watcher {
+  Watcher(Project& project)
+  : project(project)
+  , fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+  {
+  }
+  ~Watcher() {
+    close(fd);
+  }
+  std::vector<DirectoryWalker::Entry> AddTree(const std::string& root) {
+    AddWatch(root);
+    DirectoryWalker walker(project.scanThreads, [this](const std::string& path, const std::string& fileName) {
+      return (fileName.size() >= 2 && fileName[0] == '.') || project.IsItemBlacklisted(path);
+    });
+    std::vector<DirectoryWalker::Entry> entries = walker.Walk(root);
+    for (auto& e : entries) {
+      if (e.isDirectory) AddWatch(e.path);
+    }
+    return entries;
+  }
+  void AddWatch(const std::string& dir) {
+    int wd = inotify_add_watch(fd, dir.c_str(), IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF);
+    if (wd >= 0) dirs[wd] = dir;
+  }
+  void Read(Changes& changes) {
+    alignas(inotify_event) char buffer[16384];
+    while (true) {
+      ssize_t bread = read(fd, buffer, sizeof(buffer));
+      if (bread <= 0) {
+        if (bread < 0 && errno == EINTR) continue;
+        return;
+      }
+      for (char* p = buffer; p < buffer + bread; p += sizeof(inotify_event) + reinterpret_cast<inotify_event*>(p)->len) {
+        Handle(*reinterpret_cast<inotify_event*>(p), changes);
+      }
+    }
+  }
+  void Handle(const inotify_event& ev, Changes& changes) {
+    if (ev.mask & IN_Q_OVERFLOW) {
+      changes.structural = true;
+      return;
+    }
+    auto it = dirs.find(ev.wd);
+    if (it == dirs.end()) return;
+    if (ev.mask & IN_IGNORED) {
+      dirs.erase(it);
+      return;
+    }
+    if (ev.len == 0) return;
+    std::string name = ev.name;
+    std::string path = it->second + "/" + name;
+    if ((name.size() >= 2 && name[0] == '.') || project.IsItemBlacklisted(path)) return;
+    if (ev.mask & IN_ISDIR) {
+      bool isComponentPart = (name == "include" || name == "src" || name == "test");
+      if (ev.mask & (IN_CREATE | IN_MOVED_TO)) {
+        // Files may already have been created before the watch was in place. A new tree only
+        // matters structurally when it brings code along, which keeps build output dirs cheap.
+        bool newComponent = isComponentPart ||
+                            boost::filesystem::is_directory(path + "/include") ||
+                            boost::filesystem::is_directory(path + "/src");
+        bool hasCode = false;
+        for (auto& e : AddTree(path)) {
+          if (e.isDirectory && (e.hasIncludeDir || e.hasSrcDir)) newComponent = true;
+          if (e.isRegularFile && Touch(e.path, changes)) hasCode = true;
+        }
+        if (newComponent && hasCode) changes.structural = true;
+        else if (newComponent) changes.newComponents.insert(path.substr(2) + "/");
+      } else if (ev.mask & (IN_DELETE | IN_MOVED_FROM)) {
+        std::string prefix = path.substr(2) + "/";
+        for (auto& f : project.files) {
+          if (f.first.str().compare(0, prefix.size(), prefix) == 0) changes.touched.insert(f.first.str());
+        }
+        for (auto& c : project.components) {
+          if ((c.first + "/").compare(0, prefix.size() + 2, "./" + prefix) == 0) changes.structural = true;
+        }
+        if (isComponentPart) changes.structural = true;
+      }
+      return;
+    }
+    Touch(path, changes);
+  }
+  bool Touch(const std::string& path, Changes& changes) {
+    if (!project.IsCode(boost::filesystem::path(path).extension().generic_string())) return false;
+    changes.touched.insert(path.substr(2));
+    return true;
+  }
+  Project& project;
+  int fd;
+  std::unordered_map<int, std::string> dirs;
+};
+
+void Apply(Project& project, Changes& changes) {
+  for (auto& dir : changes.newComponents) {
+    auto it = changes.touched.lower_bound(dir);
+    if (it != changes.touched.end() && it->compare(0, dir.size(), dir) == 0) changes.structural = true;
+  }
+  if (changes.structural) {
+    project.ClearCommands();
+    project.Reload();
+  } else {
+    std::set<std::string> added, removed, modified;
+    for (auto& path : changes.touched) {
+      bool exists = boost::filesystem::is_regular_file("./" + path);
+      bool known = project.FindFile(path) != nullptr;
+      if (exists && known) modified.insert(path);
+      else if (exists) added.insert(path);
+      else if (known) removed.insert(path);
+    }
+    project.Reload(added, removed, modified);
+  }
+  // Empty new component directories stay pending until a full reload picks them up.
+  std::set<std::string> newComponents = changes.structural ? std::set<std::string>() : std::move(changes.newComponents);
+  changes = Changes();
+  changes.newComponents = std::move(newComponents);
+}
+
+// Reads the request line from a client. Clients are served one at a time on the thread that also
+// watches the tree, so one that never finishes its line is given up on after a few seconds.
+bool ReadRequest(int client, std::string& request) {
+  timeval timeout = { 5, 0 };
+  setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  char buffer[256];
+  while (request.size() < 4096) {
+    ssize_t bread = read(client, buffer, sizeof(buffer));
+    if (bread < 0 && errno == EINTR) continue;
+    if (bread <= 0) return false;
+    request.append(buffer, bread);
+    size_t newline = request.find('\n');
+    if (newline != std::string::npos) {
+      request.resize(newline);
+      return true;
+    }
+  }
+  return false;
+}
+
+}
+
+int RunDaemon(Project& project, std::function<int()> build) {
+  signal(SIGPIPE, SIG_IGN);
+  boost::system::error_code ec;
+  boost::filesystem::create_directories(boost::filesystem::path(socketPath).parent_path(), ec);
+  unlink(socketPath);
+  int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, socketPath, sizeof(addr.sun_path) - 1);
+  if (bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listenFd, 8) != 0) {
+    fprintf(stderr, "Cannot listen on %s: %s\n", socketPath, strerror(errno));
+    close(listenFd);
+    return 1;
+  }
+
+  Watcher watcher(project);
+  watcher.AddTree(".");
+  Changes changes;
+  printf("evoke daemon watching %zu directories, listening on %s\n", watcher.dirs.size(), socketPath);
+  fflush(stdout);
+
+  bool running = true;
+  while (running) {
+    pollfd fds[2] = { { watcher.fd, POLLIN, 0 }, { listenFd, POLLIN, 0 } };
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    if (fds[0].revents & POLLIN) watcher.Read(changes);
+    if (!(fds[1].revents & POLLIN)) continue;
+
+    int client = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (client < 0) continue;
+    std::string request;
+    if (!ReadRequest(client, request)) {
+      close(client);
+      continue;
+    }
+
+    unsigned char status = 0;
+    if (request == "stop") {
+      running = false;
+    } else if (request == "build") {
+      // Anything saved before the request was sent is already queued; pick it up first.
+      watcher.Read(changes);
+      fflush(stdout);
+      fflush(stderr);
+      int savedOut = dup(1), savedErr = dup(2);
+      dup2(client, 1);
+      dup2(client, 2);
+      Apply(project, changes);
+      status = build();
+      fflush(stdout);
+      fflush(stderr);
+      dup2(savedOut, 1);
+      dup2(savedErr, 2);
+      close(savedOut);
+      close(savedErr);
+    } else {
+      status = 2;
+    }
+    write(client, &status, 1);
+    close(client);
+  }
+  close(listenFd);
+  unlink(socketPath);
+  return 0;
+}
+
+int RunClient(const std::string& command) {
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, socketPath, sizeof(addr.sun_path) - 1);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    fprintf(stderr, "No evoke daemon is running here (%s): %s\n", socketPath, strerror(errno));
+    close(fd);
+    return 1;
+  }
+  std::string request = command + "\n";
+  write(fd, request.data(), request.size());
+
+  // The daemon relays the build output and finishes with a single status byte.
+  char buffer[4096];
+  int status = 1;
+  bool havePending = false;
+  char pending = 0;
+  while (true) {
+    ssize_t bread = read(fd, buffer, sizeof(buffer));
+    if (bread < 0 && errno == EINTR) continue;
+    if (bread <= 0) break;
+    if (havePending) fwrite(&pending, 1, 1, stdout);
+    fwrite(buffer, 1, bread - 1, stdout);
+    pending = buffer[bread - 1];
+    havePending = true;
+  }
+  fflush(stdout);
+  if (havePending) status = static_cast<unsigned char>(pending);
+  close(fd);
+  return status;
+}
@@ -3,128 +3,522 @@
 #include <thread>
 #include <unistd.h>
 #include <fcntl.h>
+#include <spawn.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <split.h>
 #include <cstring>
+#include "BuildLog.h"
+#include "BuildManifest.h"
+#include "ObjectCache.h"
 #include "PendingCommand.h"
+#include "SystemLoad.h"
+#include <algorithm>
+#include <chrono>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
 
 struct Process : public Task {
 public:
-  Process(const std::string& filename, const std::string& cmd, const std::string& statefile, std::function<void(Task*)> onComplete) 
-  : onComplete(onComplete)
-  , filename(filename)
+  Process(const std::string& filename, const std::string& cmd, const std::string& statefile, PendingCommand* command, Task** slot)
+  : filename(filename)
+  , command(command)
+  , slot(slot)
   {
     int outfd[2];
-    pipe(outfd);
-    if ((pid = fork()) == 0) {
-      close(0);
-      dup2(outfd[1], 1);
-      dup2(outfd[1], 2);
-      close(outfd[0]);
-      std::vector<char*> argv;
-      size_t start = 0, end = cmd.find_first_of(" ");
-      while (end != cmd.npos) {
-        argv.push_back(strndup(cmd.data() + start, end - start));
-        start = cmd.find_first_not_of(" ", end);
-        end = cmd.find_first_of(" ", start);
-      }
-      argv.push_back(strdup(cmd.data() + start));
-      argv.push_back(nullptr);
-      execvp(argv[0], argv.data());
-      abort();
+    pipe2(outfd, O_CLOEXEC);
+    // Everything the child needs is prepared here; posix_spawn does not copy our page tables, so
+    // starting a compiler costs the same no matter how large the project graph has grown.
+    std::vector<std::string> args;
+    size_t start = 0, end = cmd.find_first_of(" ");
+    while (end != cmd.npos) {
+      args.push_back(cmd.substr(start, end - start));
+      start = cmd.find_first_not_of(" ", end);
+      end = cmd.find_first_of(" ", start);
+    }
+    args.push_back(cmd.substr(start));
+    std::vector<char*> argv;
+    for (auto& arg : args) argv.push_back(&arg[0]);
+    argv.push_back(nullptr);
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addclose(&actions, 0);
+    posix_spawn_file_actions_adddup2(&actions, outfd[1], 1);
+    posix_spawn_file_actions_adddup2(&actions, outfd[1], 2);
+    int rv = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (rv != 0) {
+      // Reported like any other failing command: the message as its output, exit status 127.
+      std::string message = "Cannot run " + args[0] + ": " + strerror(rv) + "\n";
+      write(outfd[1], message.data(), message.size());
+      pid = -1;
+      errorcode = 127 << 8;
     }
     close(outfd[1]);
-    thread = std::thread([this, fd = outfd[0]]{ run(fd); });
-    thread.detach();
+    output.fd = outfd[0];
+    fcntl(output.fd, F_SETFL, O_NONBLOCK);
+    // Without pidfd support the child is reaped once its output closes, like a blocking reader would.
+    if (pid > 0) exit.fd = syscall(SYS_pidfd_open, pid, 0);
   }
-  ~Process() {
-//    thread.join();
-  }
-private:
-  void run(int fd) {
-    char buffer[1024];
+  // Returns true once the output pipe has closed.
+  bool ReadOutput() {
+    char buffer[16384];
     while (true) {
-      int bread = read(fd, buffer, sizeof(buffer));
-      if (bread == 0) break;
-      else if (bread < 0) {
-        if (errno == EINTR) continue;
+      ssize_t bread = read(output.fd, buffer, sizeof(buffer));
+      if (bread > 0) {
+        outbuffer.insert(outbuffer.end(), buffer, buffer + bread);
+      } else if (bread < 0 && errno == EINTR) {
+        continue;
+      } else {
+        return bread == 0 || errno != EAGAIN;
       }
-      outbuffer.insert(outbuffer.end(), buffer, buffer + bread);
     }
-    waitpid(pid, &errorcode, 0);
-    state = Done;
-    auto x = std::move(onComplete);
-    x(this);
   }
-public:
+  // Returns true once the child has been reaped.
+  bool Reap(bool block) {
+    if (pid < 0) return true;
+    int rv;
+    do {
+      rv = wait4(pid, &errorcode, block ? 0 : WNOHANG, &usage);
+    } while (rv < 0 && errno == EINTR);
+    return rv != 0;
+  }
+  struct Source {
+    Process* process;
+    int fd = -1;
+    bool open = true;
+  };
   int pid = 0;
-  std::thread thread;
-  std::function<void(Task*)> onComplete;
   std::string filename;
+  PendingCommand* command;
+  Task** slot;
+  std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+  std::chrono::system_clock::time_point startedAt = std::chrono::system_clock::now();
+  struct rusage usage = {};
+  // Key to store the output under in the object cache once the command succeeds; 0 if it is not cached.
+  uint64_t cacheKey = 0;
+  Source output{this}, exit{this};
 };
 
-Executor::Executor() {
-  for (size_t n = 0; n < 4; n++) activeTasks.push_back(nullptr);
+static int64_t MicrosecondsSinceEpoch(std::chrono::system_clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+}
+
+static std::string FormatDuration(uint64_t us) {
+  char buffer[32];
+  uint64_t seconds = (us + 999999) / 1000000;
+  if (seconds < 60) snprintf(buffer, sizeof(buffer), "%us", unsigned(seconds));
+  else if (seconds < 3600) snprintf(buffer, sizeof(buffer), "%um%02us", unsigned(seconds / 60), unsigned(seconds % 60));
+  else snprintf(buffer, sizeof(buffer), "%uh%02um", unsigned(seconds / 3600), unsigned(seconds / 60 % 60));
+  return buffer;
+}
+
+static bool ByCriticalPath(PendingCommand* a, PendingCommand* b) {
+  return a->criticalPath < b->criticalPath;
+}
+
+Executor::Executor(BuildLog& log, ObjectCache* cache, size_t jobs, bool adaptive, uint64_t memoryBudgetKb)
+: log(log)
+, cache(cache)
+, activeTasks(adaptive ? 2 * jobs : jobs, nullptr)
+, slots(jobs)
+, adaptive(adaptive)
+, cpus(AvailableCpus())
+, memoryBudgetKb(memoryBudgetKb)
+, lastAdapted(std::chrono::steady_clock::now())
+, epollFd(epoll_create1(EPOLL_CLOEXEC))
+, wakeFd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+{
+  epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.ptr = nullptr;
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+  loop = std::thread([this]{ EventLoop(); });
+  // Jobs are short or wait for the disk and the network, so a few workers serve any number of slots.
+  for (size_t n = 0; n < 4; n++) workers.emplace_back([this]{ Work(); });
+}
+
+Executor::~Executor() {
+  {
+    std::lock_guard<std::mutex> l(m);
+    stopping = true;
+  }
+  jobQueued.notify_all();
+  for (auto& t : workers) t.join();
+  uint64_t one = 1;
+  write(wakeFd, &one, sizeof(one));
+  loop.join();
+  close(wakeFd);
+  close(epollFd);
+}
+
+void Executor::Watch(Process* process) {
+  epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.ptr = &process->output;
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, process->output.fd, &ev);
+  if (process->exit.fd >= 0) {
+    ev.data.ptr = &process->exit;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, process->exit.fd, &ev);
+  }
+}
+
+void Executor::EventLoop() {
+  epoll_event events[64];
+  while (true) {
+    int count = epoll_wait(epollFd, events, 64, adaptive ? 1000 : -1);
+    if (count < 0) {
+      if (errno == EINTR) continue;
+      return;
+    }
+    if (adaptive && std::chrono::steady_clock::now() - lastAdapted >= std::chrono::seconds(1)) {
+      Adapt();
+    }
+    for (int n = 0; n < count; n++) {
+      Process::Source* source = static_cast<Process::Source*>(events[n].data.ptr);
+      if (!source) {
+        uint64_t value;
+        read(wakeFd, &value, sizeof(value));
+        std::lock_guard<std::mutex> l(m);
+        if (stopping) return;
+        continue;
+      }
+      Process* process = source->process;
+      if (source == &process->output ? process->ReadOutput() : process->Reap(false)) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, source->fd, nullptr);
+        close(source->fd);
+        source->open = false;
+      }
+      if (process->output.open) continue;
+      if (process->exit.fd < 0) process->Reap(true);
+      else if (process->exit.open) continue;
+      process->state = Task::Done;
+      OnComplete(process);
+    }
+  }
+}
+
+void Executor::OnComplete(Process* t) {
+  PendingCommand* c = t->command;
+  // TODO: print errors from this command first
+  if (t->errorcode || !t->outbuffer.empty()) {
+    t->outbuffer.push_back(0);
+    printf("\n\nError while running command for %s:\n$ %s\n%s\n", c->outputs[0]->path.filename().string().c_str(), c->commandToRun.c_str(), t->outbuffer.data());
+  }
+  {
+    std::lock_guard<std::mutex> l(m);
+    *t->slot = nullptr;
+    BuildLog::Entry entry = {};
+    entry.commandHash = c->commandHash;
+    entry.startUs = MicrosecondsSinceEpoch(t->startedAt);
+    entry.endUs = MicrosecondsSinceEpoch(std::chrono::system_clock::now());
+    entry.exitCode = t->errorcode;
+    entry.userUs = t->usage.ru_utime.tv_sec * 1000000ULL + t->usage.ru_utime.tv_usec;
+    entry.systemUs = t->usage.ru_stime.tv_sec * 1000000ULL + t->usage.ru_stime.tv_usec;
+    entry.maxRssKb = t->usage.ru_maxrss;
+    log.Record(entry);
+    remainingWork -= std::min(remainingWork, c->expectedDuration);
+    memoryInUseKb -= std::min(memoryInUseKb, c->expectedRssKb);
+    // Commands that printed warnings are not cached, so the warnings show up again on every rebuild.
+    bool success = t->errorcode == 0;
+    uint64_t storeKey = (success && t->outbuffer.empty()) ? t->cacheKey : 0;
+    Queue([this, c, success, storeKey]{ Finish(c, success, storeKey); });
+  }
+  delete t;
+  RunMoreCommands();
+}
+
+void Executor::Finish(PendingCommand* c, bool success, uint64_t storeKey) {
+  // Storing may copy the whole output, so like the hashing it stays out of the lock.
+  if (storeKey) cache->Store(storeKey, c->outputs[0]->path.string());
+  c->HashOutputs(success);
+  std::vector<PendingCommand*> unblocked;
+  {
+    std::lock_guard<std::mutex> l(m);
+    remaining--;
+    c->SetResult(success);
+    // A failed command leaves its outputs in Error, which keeps everything depending on them blocked.
+    if (success) Release(c, unblocked);
+  }
+  Settle(unblocked);
+}
+
+void Executor::Release(PendingCommand* c, std::vector<PendingCommand*>& unblocked) {
+  for (auto& o : c->outputs) {
+    for (auto& listener : o->listeners) {
+      if (!listener->blockedInputs || --listener->blockedInputs != 0 || listener->state != PendingCommand::ToBeRun) continue;
+      unblocked.push_back(listener);
+    }
+  }
+}
+
+void Executor::Settle(std::vector<PendingCommand*>& unblocked) {
+  while (!unblocked.empty()) {
+    PendingCommand* c = unblocked.back();
+    unblocked.pop_back();
+    // Everything CanSkip reads was settled before c was unblocked, and it may hash inputs.
+    bool skip = c->CanSkip();
+    std::lock_guard<std::mutex> l(m);
+    if (skip) {
+      c->Skip();
+      remaining--;
+      skipped++;
+      remainingWork -= std::min(remainingWork, c->expectedDuration);
+      Release(c, unblocked);
+    } else {
+      ready.push_back(c);
+      std::push_heap(ready.begin(), ready.end(), ByCriticalPath);
+    }
+  }
+}
+
+void Executor::Queue(std::function<void()> job) {
+  jobs.push_back(std::move(job));
+  pendingJobs++;
+  jobQueued.notify_one();
 }
 
-Executor::~Executor() {}
+void Executor::Work() {
+  std::unique_lock<std::mutex> l(m);
+  while (true) {
+    jobQueued.wait(l, [this]{ return stopping || !jobs.empty(); });
+    if (stopping) return;
+    std::function<void()> job = std::move(jobs.front());
+    jobs.pop_front();
+    l.unlock();
+    job();
+    l.lock();
+    pendingJobs--;
+    l.unlock();
+    RunMoreCommands();
+    l.lock();
+  }
+}
 
 void Executor::Run(PendingCommand* cmd) {
   std::lock_guard<std::mutex> l(m);
-  commands.push_back(cmd);
+  remaining++;
+  registered.push_back(cmd);
+  cmd->blockedInputs = cmd->CountBlockedInputs();
+  if (cmd->blockedInputs == 0) ready.push_back(cmd);
 }
 
-bool Executor::Busy() {
-  // What if they just all finished and just haven't started another yet?
-  std::lock_guard<std::mutex> l(m);
-  for (auto& c : activeTasks) {
-    if (c && c->state != Task::Done) return true;
+uint64_t Executor::EstimateDuration(PendingCommand* cmd) {
+  const BuildLog::Entry* entry = log.Find(cmd->commandHash);
+  if (entry) return entry->DurationUs();
+  // Never run before; assume cost grows with the amount of source it reads, at roughly 20 bytes per microsecond.
+  uint64_t bytes = 0;
+  for (auto& in : cmd->inputs) {
+    in->lastwrite();
+    bytes += in->size;
+  }
+  return 1000 + bytes / 20;
+}
+
+uint64_t Executor::EstimateRss(PendingCommand* cmd) {
+  const BuildLog::Entry* entry = log.Find(cmd->commandHash);
+  // Leave some headroom over the last peak. Commands never seen before get a guess by kind:
+  // template-heavy TUs easily take half a gigabyte, archiving next to nothing, big links a
+  // gigabyte or more.
+  if (entry && entry->maxRssKb) return entry->maxRssKb + entry->maxRssKb / 4;
+  std::string extension = cmd->outputs.empty() ? "" : cmd->outputs[0]->path.extension().string();
+  if (extension == ".o") return 512 << 10;
+  if (extension == ".a") return 64 << 10;
+  return 1 << 20;
+}
+
+uint64_t Executor::CriticalPath(PendingCommand* cmd) {
+  auto it = visiting.find(cmd);
+  if (it != visiting.end()) return it->second ? 0 : cmd->criticalPath;
+  visiting[cmd] = true;
+  uint64_t longestAfter = 0;
+  for (auto& o : cmd->outputs) {
+    for (auto& listener : o->listeners) {
+      if (listener->state == PendingCommand::ToBeRun) longestAfter = std::max(longestAfter, CriticalPath(listener));
+    }
   }
-  return false;
+  cmd->expectedDuration = EstimateDuration(cmd);
+  cmd->criticalPath = cmd->expectedDuration + longestAfter;
+  visiting[cmd] = false;
+  return cmd->criticalPath;
+}
+
+void Executor::Wait() {
+  std::unique_lock<std::mutex> l(m);
+  idle.wait(l, [this]{ return finished; });
+  if (skipped) printf("\n\n%zu commands skipped because their inputs came out unchanged\n", skipped);
+  if (heldBack) printf("\n\n%zu commands waited for memory to start, with a memory budget of %.1f GB\n", heldBack, memoryBudgetKb / 1048576.0);
+}
+
+uint64_t Executor::EstimateRemaining() {
+  // The build takes at least as long as its longest remaining chain, and at least as long as the
+  // remaining work spread over all slots.
+  auto now = std::chrono::steady_clock::now();
+  uint64_t longestChain = ready.empty() ? 0 : ready.front()->criticalPath;
+  if (!deferred.empty()) longestChain = std::max(longestChain, deferred.front()->criticalPath);
+  uint64_t work = remainingWork;
+  for (auto& t : activeTasks) {
+    if (!t) continue;
+    Process* p = static_cast<Process*>(t);
+    uint64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - p->started).count();
+    elapsed = std::min(elapsed, p->command->expectedDuration);
+    longestChain = std::max(longestChain, p->command->criticalPath - elapsed);
+    work -= std::min(work, elapsed);
+  }
+  return std::max(longestChain, work / std::max<size_t>(slots, 1));
 }
 
 void Executor::Start() {
+  {
+    std::lock_guard<std::mutex> l(m);
+    for (auto& c : registered) {
+      CriticalPath(c);
+      c->expectedRssKb = EstimateRss(c);
+      remainingWork += c->expectedDuration;
+    }
+    visiting.clear();
+    std::make_heap(ready.begin(), ready.end(), ByCriticalPath);
+    started = true;
+  }
   RunMoreCommands();
 }
 
+void Executor::Adapt() {
+  SystemLoad load = ReadSystemLoad();
+  {
+    std::lock_guard<std::mutex> l(m);
+    lastAdapted = std::chrono::steady_clock::now();
+    if (!started) return;
+    size_t before = slots;
+    // Memory stalls mean swapping or reclaim, which only get worse with more jobs; back off hard.
+    if (load.memoryPressure > 10) {
+      slots = std::max<size_t>(1, slots / 2);
+    } else if (load.cpuPressure > 60 || load.loadAverage > 1.5 * cpus) {
+      slots = std::max<size_t>(1, slots - 1);
+    } else if ((!ready.empty() || !deferred.empty()) && load.memoryPressure < 1 && load.cpuPressure < 20 && load.loadAverage < cpus) {
+      slots = std::min(activeTasks.size(), slots + 1);
+    }
+    if (slots <= before) return;
+  }
+  RunMoreCommands();
+}
+
+PendingCommand* Executor::TakeReadyCommand(size_t active) {
+  // Highest priority first, passing over commands that do not fit in the memory left. With nothing
+  // running anything goes, or a command bigger than the whole budget would never start.
+  auto fits = [this, active](PendingCommand* c) {
+    return !memoryBudgetKb || active == 0 || memoryInUseKb + c->expectedRssKb <= memoryBudgetKb;
+  };
+  // The best deferred command that fits by now competes with the top of the heap.
+  auto candidate = std::find_if(deferred.begin(), deferred.end(), fits);
+  while (!ready.empty()) {
+    PendingCommand* c = ready.front();
+    if (candidate != deferred.end() && !ByCriticalPath(*candidate, c)) break;
+    std::pop_heap(ready.begin(), ready.end(), ByCriticalPath);
+    ready.pop_back();
+    if (fits(c)) return c;
+    heldBack++;
+    size_t index = candidate - deferred.begin();
+    auto at = std::upper_bound(deferred.begin(), deferred.end(), c, [](PendingCommand* a, PendingCommand* b) { return ByCriticalPath(b, a); });
+    if (at - deferred.begin() <= ptrdiff_t(index)) index++;
+    deferred.insert(at, c);
+    candidate = deferred.begin() + index;
+  }
+  if (candidate == deferred.end()) return nullptr;
+  PendingCommand* c = *candidate;
+  deferred.erase(candidate);
+  return c;
+}
+
 void Executor::RunMoreCommands() {
   std::lock_guard<std::mutex> l(m);
+  size_t active = 0;
+  for (auto& t: activeTasks) if (t) active++;
   auto it = activeTasks.begin();
-  for (auto& c : commands) {
+  while ((!ready.empty() || !deferred.empty()) && active < slots) {
     while (it != activeTasks.end() && *it) ++it;
     if (it == activeTasks.end()) break;
-    // TODO: take into account its relative load
-    if (c->CanRun()) {
-      c->state = PendingCommand::Running;
-      for (auto& o : c->outputs) {
-        boost::filesystem::create_directories(o->path.parent_path());
-      }
-      *it = new Process(c->outputs[0]->path.filename().string(), c->commandToRun, "", [this, it, c](Task* t){
-        *it = nullptr;
-        // TODO: print errors from this command first
-        if (t->errorcode || !t->outbuffer.empty()) {
-          t->outbuffer.push_back(0);
-          printf("\n\nError while running command for %s:\n$ %s\n%s\n", c->outputs[0]->path.filename().string().c_str(), c->commandToRun.c_str(), t->outbuffer.data());
+    PendingCommand* c = TakeReadyCommand(active);
+    if (!c) break;
+    for (auto& o : c->outputs) {
+      boost::filesystem::create_directories(o->path.parent_path());
+      // Commands write new files instead of rewriting old ones, which may be linked into the object cache.
+      unlink(o->path.c_str());
+    }
+    bool cacheable = cache && c->cacheable && c->manifest && c->outputs.size() == 1;
+    uint64_t cacheKey = 0;
+    auto looked = lookedUp.find(c);
+    if (looked != lookedUp.end()) {
+      // Missed in the remote cache as well, so it runs after all, with the digest taken before the lookup.
+      cacheKey = looked->second;
+      lookedUp.erase(looked);
+    } else {
+      // All inputs are built by now; the digest is taken before the command can see any later edits.
+      c->inputsDigest = (cacheable || (c->manifest && c->manifest->contentHash)) ? c->InputsDigest() : 0;
+      if (cacheable) {
+        cacheKey = cache->Key(c->commandToRun, c->inputsDigest);
+        if (cache->FetchLocal(cacheKey, c->outputs[0]->path.string())) {
+          remainingWork -= std::min(remainingWork, c->expectedDuration);
+          c->state = PendingCommand::Running;
+          Queue([this, c]{ Finish(c, true); });
+          continue;
+        }
+        if (cache->HasRemote()) {
+          c->state = PendingCommand::Running;
+          Queue([this, c, cacheKey]{
+            if (cache->FetchRemote(cacheKey, c->outputs[0]->path.string())) {
+              {
+                std::lock_guard<std::mutex> l(m);
+                remainingWork -= std::min(remainingWork, c->expectedDuration);
+              }
+              Finish(c, true);
+              return;
+            }
+            std::lock_guard<std::mutex> l(m);
+            c->state = PendingCommand::ToBeRun;
+            lookedUp[c] = cacheKey;
+            ready.push_back(c);
+            std::push_heap(ready.begin(), ready.end(), ByCriticalPath);
+          });
+          continue;
         }
-        c->SetResult(t->errorcode == 0);
-        delete t;
-        RunMoreCommands();
-      });
-    } else {;}
+      }
+    }
+    active++;
+    memoryInUseKb += c->expectedRssKb;
+    c->state = PendingCommand::Running;
+    Process* process = new Process(c->outputs[0]->path.filename().string(), c->commandToRun, "", c, &*it);
+    process->cacheKey = cacheKey;
+    *it = process;
+    Watch(process);
   }
   
-  size_t w = 80 / activeTasks.size();
-  size_t active = 0;
-  for (auto& t: activeTasks) if (t) active++;
+  // Completions and jobs are the only things that can make another command runnable, so with
+  // none pending we are done.
+  if (active == 0 && pendingJobs == 0) {
+    finished = true;
+    idle.notify_all();
+  }
 
-  printf("%zu concurrent tasks, %zu active, %zu commands left to run\n", activeTasks.size(), active, commands.size());
+  printf("%zu concurrent tasks, %zu active, %zu commands left to run, about %s to go\n", slots, active, remaining - active,
+         FormatDuration(EstimateRemaining()).c_str());
+  // One box per slot, up to what fits on a line; running tasks come first.
+  size_t boxes = std::min<size_t>(std::max<size_t>(slots, 1), 8);
+  size_t w = 80 / boxes;
+  std::vector<std::string> names;
   for (auto& t : activeTasks) {
-    std::string file;
-    if (t) {
-      file = ((Process*)t)->filename;
-      if (file.size() > w-3) file.resize(w-3);
-    }
+    if (t) names.push_back(((Process*)t)->filename);
+  }
+  names.resize(std::max(names.size(), boxes));
+  for (size_t n = 0; n < boxes; n++) {
+    std::string& file = names[n];
+    if (file.size() > w-3) file.resize(w-3);
     while (file.size() < w-3) file.push_back(' ');
     printf("\033[1;37m[\033[0m%s\033[1;37m]\033[0m ", file.c_str());
   }
@@ -0,0 +1,213 @@
+#include "ObjectCache.h"
+#include "Hash.h"
+#include "RemoteCache.h"
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <cstdio>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+// A reflink shares blocks with the original until either is written, which costs nothing but
+// only works within one filesystem that supports it.
+static bool Reflink(const std::string& from, const std::string& to) {
+  int in = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+  if (in < 0) return false;
+  int out = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  bool ok = out >= 0 && ioctl(out, FICLONE, in) == 0;
+  if (out >= 0) close(out);
+  close(in);
+  if (!ok) unlink(to.c_str());
+  return ok;
+}
+
+static bool Copy(const std::string& from, const std::string& to) {
+  int in = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+  if (in < 0) return false;
+  int out = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  bool ok = out >= 0;
+  char buffer[65536];
+  ssize_t bread;
+  while (ok && (bread = read(in, buffer, sizeof(buffer))) > 0) {
+    ok = write(out, buffer, bread) == bread;
+  }
+  if (out >= 0) ok = (close(out) == 0) && ok;
+  close(in);
+  if (!ok) unlink(to.c_str());
+  return ok;
+}
+
+static std::string FormatSize(uint64_t bytes) {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%.1f MB", bytes / 1048576.0);
+  return buffer;
+}
+
+ObjectCache::ObjectCache(const std::string& dir, uint64_t maxBytes, const std::string& remoteUrl)
+: dir(dir)
+, maxBytes(maxBytes)
+{
+  if (!remoteUrl.empty()) {
+    remote = std::make_unique<RemoteCache>(remoteUrl);
+    if (!remote->Valid()) remote.reset();
+  }
+}
+
+ObjectCache::~ObjectCache() = default;
+
+uint64_t ObjectCache::Key(const std::string& command, uint64_t inputsDigest) {
+  uint64_t parts[3] = { Fnv1a(command), inputsDigest, ToolHash(command.substr(0, command.find(' '))) };
+  return Xxh64(parts, sizeof(parts));
+}
+
+bool ObjectCache::Fetch(uint64_t key, const std::string& path) {
+  return FetchLocal(key, path) || (remote && FetchRemote(key, path));
+}
+
+bool ObjectCache::FetchLocal(uint64_t key, const std::string& path) {
+  if (Materialise(EntryPath(dir, key), path)) {
+    hits++;
+    return true;
+  }
+  if (!remote) misses++;
+  return false;
+}
+
+bool ObjectCache::FetchRemote(uint64_t key, const std::string& path) {
+  std::string entry = EntryPath(dir, key);
+  if (Download(key, entry) && Materialise(entry, path)) {
+    hits++;
+    return true;
+  }
+  misses++;
+  return false;
+}
+
+bool ObjectCache::Materialise(const std::string& entry, const std::string& path) {
+  std::string tmpname = path + ".cache-tmp";
+  unlink(tmpname.c_str());
+  // The executor removes outputs before running a command, so a hardlinked entry is never
+  // overwritten in place by a later compile.
+  if (!Reflink(entry, tmpname) && link(entry.c_str(), tmpname.c_str()) != 0 && !Copy(entry, tmpname)) return false;
+  if (rename(tmpname.c_str(), path.c_str()) != 0) {
+    unlink(tmpname.c_str());
+    return false;
+  }
+  // The output has to look freshly built; the entry's mtime doubles as its last use for Trim.
+  utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+  utimensat(AT_FDCWD, entry.c_str(), nullptr, 0);
+  return true;
+}
+
+bool ObjectCache::Download(uint64_t key, const std::string& entry) {
+  std::vector<char> data;
+  if (!remote->Get(key, data)) return false;
+  boost::system::error_code ec;
+  boost::filesystem::create_directories(boost::filesystem::path(entry).parent_path(), ec);
+  std::string tmpname = entry + ".tmp" + std::to_string(getpid());
+  FILE* file = fopen(tmpname.c_str(), "wb");
+  bool written = file && fwrite(data.data(), 1, data.size(), file) == data.size();
+  if (file) written = (fclose(file) == 0) && written;
+  if (!written || rename(tmpname.c_str(), entry.c_str()) != 0) {
+    unlink(tmpname.c_str());
+    return false;
+  }
+  return true;
+}
+
+void ObjectCache::Store(uint64_t key, const std::string& path) {
+  std::string entry = EntryPath(dir, key);
+  if (access(entry.c_str(), F_OK) == 0) return;
+  boost::system::error_code ec;
+  boost::filesystem::create_directories(boost::filesystem::path(entry).parent_path(), ec);
+  // Entries get an inode of their own, so whatever happens to the output later cannot change them.
+  std::string tmpname = entry + ".tmp" + std::to_string(getpid());
+  if (!Reflink(path, tmpname) && !Copy(path, tmpname)) return;
+  if (rename(tmpname.c_str(), entry.c_str()) != 0) {
+    unlink(tmpname.c_str());
+    return;
+  }
+  struct stat st;
+  if (stat(entry.c_str(), &st) == 0) bytesStored += st.st_size;
+  stores++;
+  if (remote) remote->Put(key, entry);
+}
+
+void ObjectCache::Trim() {
+  struct Entry {
+    std::time_t lastUse;
+    uint64_t size;
+    std::string path;
+  };
+  // Only stores make the cache grow, so builds without any skip the walk.
+  if (stores == 0) return;
+  std::vector<Entry> entries;
+  bytesInCache = 0;
+  boost::system::error_code ec;
+  for (boost::filesystem::recursive_directory_iterator it(dir, ec), end; it != end; it.increment(ec)) {
+    if (ec) break;
+    struct stat st;
+    if (lstat(it->path().c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+    entries.push_back({ st.st_mtime, uint64_t(st.st_size), it->path().string() });
+    bytesInCache += st.st_size;
+  }
+  if (bytesInCache <= maxBytes) return;
+  // Evict down to 90% so that the next few builds do not have to walk the cache again.
+  std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.lastUse < b.lastUse; });
+  for (auto& e : entries) {
+    if (bytesInCache <= maxBytes / 10 * 9) break;
+    if (unlink(e.path.c_str()) != 0) continue;
+    bytesInCache -= e.size;
+    bytesEvicted += e.size;
+  }
+}
+
+void ObjectCache::PrintStatistics() {
+  if (remote) remote->PrintStatistics();
+  if (hits + misses == 0) return;
+  printf("Object cache: %zu hits, %zu misses, %zu stored (%s)", hits.load(), misses.load(), stores.load(), FormatSize(bytesStored.load()).c_str());
+  if (bytesInCache) printf(", %s of %s in use", FormatSize(bytesInCache).c_str(), FormatSize(maxBytes).c_str());
+  if (bytesEvicted) printf(", %s evicted", FormatSize(bytesEvicted).c_str());
+  printf("\n");
+  hits = misses = stores = 0;
+  bytesStored = 0;
+  bytesInCache = bytesEvicted = 0;
+}
+
+std::string ObjectCache::EntryPath(const std::string& dir, uint64_t key) {
+  char name[20];
+  snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+  return dir + "/" + std::string(name, 2) + "/" + std::string(name + 2);
+}
+
+uint64_t ObjectCache::ToolHash(const std::string& program) {
+  auto it = toolHashes.find(program);
+  if (it != toolHashes.end()) return it->second;
+  std::string resolved;
+  if (program.find('/') != std::string::npos) {
+    resolved = program;
+  } else if (const char* path = getenv("PATH")) {
+    std::string paths = path;
+    for (size_t start = 0, end; start <= paths.size(); start = end + 1) {
+      end = paths.find(':', start);
+      if (end == std::string::npos) end = paths.size();
+      std::string candidate = paths.substr(start, end - start) + "/" + program;
+      if (access(candidate.c_str(), X_OK) == 0) {
+        resolved = candidate;
+        break;
+      }
+    }
+  }
+  uint64_t hash = 0;
+  struct stat st;
+  if (!resolved.empty() && stat(resolved.c_str(), &st) == 0) {
+    int64_t identity[2] = { int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec, int64_t(st.st_size) };
+    hash = Xxh64(identity, sizeof(identity), Fnv1a(resolved));
+  }
+  toolHashes[program] = hash;
+  return hash;
+}
+
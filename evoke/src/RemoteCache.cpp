@@ -0,0 +1,289 @@
+#include "RemoteCache.h"
+#include "ObjectCache.h"
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const size_t maxEntrySize = 1 << 30;
+
+static bool SendAll(int fd, const char* data, size_t size) {
+  while (size) {
+    ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) continue;
+    if (sent <= 0) return false;
+    data += sent;
+    size -= sent;
+  }
+  return true;
+}
+
+static void SetTimeouts(int fd) {
+  timeval timeout = { 5, 0 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+static bool ReadFile(const std::string& path, std::vector<char>& data) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) return false;
+  data.clear();
+  char buffer[65536];
+  size_t bread;
+  while ((bread = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    data.insert(data.end(), buffer, buffer + bread);
+  }
+  bool ok = !ferror(file);
+  fclose(file);
+  return ok;
+}
+
+// Value of a header in a request or response head, or npos if it is absent.
+static size_t HeaderValue(const std::string& head, const std::string& name) {
+  std::string lower = head;
+  std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+  size_t pos = lower.find("\r\n" + name + ":");
+  if (pos == std::string::npos) return std::string::npos;
+  return strtoull(head.c_str() + pos + name.size() + 3, nullptr, 10);
+}
+
+static std::string KeyName(uint64_t key) {
+  char name[20];
+  snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+  return name;
+}
+
+RemoteCache::RemoteCache(const std::string& url) {
+  const std::string scheme = "http://";
+  if (url.compare(0, scheme.size(), scheme) != 0) {
+    fprintf(stderr, "Remote cache %s is not an http:// URL, not using it\n", url.c_str());
+    return;
+  }
+  size_t slash = url.find('/', scheme.size());
+  std::string hostport = url.substr(scheme.size(), slash == std::string::npos ? std::string::npos : slash - scheme.size());
+  prefix = slash == std::string::npos ? "" : url.substr(slash);
+  while (!prefix.empty() && prefix.back() == '/') prefix.pop_back();
+  size_t colon = hostport.rfind(':');
+  host = hostport.substr(0, colon);
+  port = colon == std::string::npos ? "80" : hostport.substr(colon + 1);
+  uploader = std::thread([this] { Upload(); });
+}
+
+RemoteCache::~RemoteCache() {
+  if (!uploader.joinable()) return;
+  {
+    std::lock_guard<std::mutex> l(m);
+    stopping = true;
+  }
+  queued.notify_all();
+  uploader.join();
+}
+
+bool RemoteCache::Get(uint64_t key, std::vector<char>& data) {
+  {
+    std::lock_guard<std::mutex> l(m);
+    if (!available) return false;
+  }
+  int status = 0;
+  bool ok = Request("GET", key, {}, status, data) && status == 200;
+  std::lock_guard<std::mutex> l(m);
+  if (ok) hits++;
+  else misses++;
+  return ok;
+}
+
+void RemoteCache::Put(uint64_t key, const std::string& path) {
+  {
+    std::lock_guard<std::mutex> l(m);
+    uploads.emplace_back(key, path);
+  }
+  queued.notify_one();
+}
+
+void RemoteCache::Upload() {
+  std::unique_lock<std::mutex> l(m);
+  while (true) {
+    queued.wait(l, [this] { return stopping || !uploads.empty(); });
+    if (uploads.empty()) return;
+    std::pair<uint64_t, std::string> upload = uploads.front();
+    uploads.pop_front();
+    if (!available) {
+      failures++;
+      continue;
+    }
+    uploading = true;
+    l.unlock();
+    std::vector<char> body, response;
+    int status = 0;
+    // The entry may have been evicted locally in the meantime; then there is nothing to share.
+    bool ok = ReadFile(upload.second, body) && Request("PUT", upload.first, body, status, response) && status / 100 == 2;
+    l.lock();
+    uploading = false;
+    if (ok) uploaded++;
+    else failures++;
+  }
+}
+
+void RemoteCache::PrintStatistics() {
+  std::lock_guard<std::mutex> l(m);
+  if (hits + misses + uploaded + failures == 0 && available) return;
+  printf("Remote cache: %zu hits, %zu misses, %zu uploaded, %zu failed, %zu still queued%s\n", hits, misses, uploaded, failures, uploads.size() + uploading,
+         available ? "" : " (server unreachable)");
+  hits = misses = uploaded = failures = 0;
+  available = true;
+}
+
+bool RemoteCache::Request(const std::string& method, uint64_t key, const std::vector<char>& body, int& status, std::vector<char>& response) {
+  addrinfo hints = {};
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* addresses;
+  int fd = -1;
+  if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) == 0) {
+    for (addrinfo* ai = addresses; ai && fd < 0; ai = ai->ai_next) {
+      fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+      if (fd < 0) continue;
+      SetTimeouts(fd);
+      if (connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+      }
+    }
+    freeaddrinfo(addresses);
+  }
+  if (fd < 0) {
+    std::lock_guard<std::mutex> l(m);
+    if (available) fprintf(stderr, "Cannot reach remote cache at %s:%s, not using it for this build\n", host.c_str(), port.c_str());
+    available = false;
+    return false;
+  }
+  std::string head = method + " " + prefix + "/" + KeyName(key) + " HTTP/1.1\r\nHost: " + host + ":" + port +
+                     "\r\nConnection: close\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+  bool ok = SendAll(fd, head.data(), head.size()) && SendAll(fd, body.data(), body.size());
+  response.clear();
+  char buffer[65536];
+  ssize_t bread = 0;
+  while (ok && (bread = read(fd, buffer, sizeof(buffer))) != 0) {
+    if (bread < 0 && errno == EINTR) continue;
+    if (bread < 0 || response.size() > maxEntrySize) ok = false;
+    else response.insert(response.end(), buffer, buffer + bread);
+  }
+  close(fd);
+  if (!ok) return false;
+
+  std::string text(response.data(), std::min<size_t>(response.size(), 16384));
+  size_t headEnd = text.find("\r\n\r\n");
+  size_t space = text.find(' ');
+  if (text.compare(0, 5, "HTTP/") != 0 || headEnd == std::string::npos || space > headEnd) return false;
+  status = atoi(text.c_str() + space + 1);
+  std::string responseHead = text.substr(0, headEnd);
+  // Bodies are taken up to the end of the connection; a chunked one would be taken apart wrongly.
+  if (responseHead.find("hunked") != std::string::npos) return false;
+  size_t contentLength = HeaderValue(responseHead, "content-length");
+  response.erase(response.begin(), response.begin() + headEnd + 4);
+  return contentLength == std::string::npos || contentLength == response.size();
+}
+
+static void Respond(int fd, int status, const char* reason, const std::vector<char>& body = {}) {
+  std::string head = "HTTP/1.1 " + std::to_string(status) + " " + reason + "\r\nContent-Length: " + std::to_string(body.size()) +
+                     "\r\nConnection: close\r\n\r\n";
+  if (SendAll(fd, head.data(), head.size())) SendAll(fd, body.data(), body.size());
+}
+
+static void Serve(int fd, const std::string& dir) {
+  std::vector<char> request;
+  char buffer[65536];
+  size_t headEnd = std::string::npos;
+  while (headEnd == std::string::npos) {
+    ssize_t bread = read(fd, buffer, sizeof(buffer));
+    if (bread < 0 && errno == EINTR) continue;
+    if (bread <= 0 || request.size() > 16384) return;
+    request.insert(request.end(), buffer, buffer + bread);
+    std::string text(request.data(), request.size());
+    headEnd = text.find("\r\n\r\n");
+  }
+  std::string head(request.data(), headEnd);
+  request.erase(request.begin(), request.begin() + headEnd + 4);
+  size_t methodEnd = head.find(' ');
+  size_t pathEnd = head.find(' ', methodEnd + 1);
+  if (methodEnd == std::string::npos || pathEnd == std::string::npos) return Respond(fd, 400, "Bad Request");
+  std::string method = head.substr(0, methodEnd);
+  std::string path = head.substr(methodEnd + 1, pathEnd - methodEnd - 1);
+  // Only the key is looked at, which also keeps requests from reaching outside dir.
+  std::string name = path.substr(path.rfind('/') + 1);
+  if (name.size() != 16 || name.find_first_not_of("0123456789abcdef") != std::string::npos) return Respond(fd, 404, "Not Found");
+  std::string entry = ObjectCache::EntryPath(dir, strtoull(name.c_str(), nullptr, 16));
+
+  if (method == "GET") {
+    std::vector<char> body;
+    if (!ReadFile(entry, body)) return Respond(fd, 404, "Not Found");
+    return Respond(fd, 200, "OK", body);
+  }
+  if (method != "PUT") return Respond(fd, 405, "Method Not Allowed");
+  size_t contentLength = HeaderValue(head, "content-length");
+  if (contentLength == std::string::npos) return Respond(fd, 411, "Length Required");
+  if (contentLength > maxEntrySize) return Respond(fd, 413, "Payload Too Large");
+  while (request.size() < contentLength) {
+    ssize_t bread = read(fd, buffer, std::min(sizeof(buffer), contentLength - request.size()));
+    if (bread < 0 && errno == EINTR) continue;
+    if (bread <= 0) return;
+    request.insert(request.end(), buffer, buffer + bread);
+  }
+  request.resize(contentLength);
+  boost::system::error_code ec;
+  boost::filesystem::create_directories(boost::filesystem::path(entry).parent_path(), ec);
+  std::string tmpname = entry + ".tmp" + std::to_string(getpid());
+  FILE* file = fopen(tmpname.c_str(), "wb");
+  bool written = file && fwrite(request.data(), 1, request.size(), file) == request.size();
+  if (file) written = (fclose(file) == 0) && written;
+  if (!written || rename(tmpname.c_str(), entry.c_str()) != 0) {
+    unlink(tmpname.c_str());
+    return Respond(fd, 500, "Internal Server Error");
+  }
+  Respond(fd, 201, "Created");
+}
+
+int RunCacheServer(const std::string& listenOn, const std::string& dir) {
+  signal(SIGPIPE, SIG_IGN);
+  size_t colon = listenOn.rfind(':');
+  std::string address = colon == std::string::npos ? "127.0.0.1" : listenOn.substr(0, colon);
+  std::string port = listenOn.substr(colon == std::string::npos ? 0 : colon + 1);
+  addrinfo hints = {};
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  addrinfo* addresses;
+  if (getaddrinfo(address.c_str(), port.c_str(), &hints, &addresses) != 0) {
+    fprintf(stderr, "Cannot resolve %s\n", listenOn.c_str());
+    return 1;
+  }
+  int listenFd = socket(addresses->ai_family, addresses->ai_socktype | SOCK_CLOEXEC, addresses->ai_protocol);
+  int one = 1;
+  setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  bool listening = listenFd >= 0 && bind(listenFd, addresses->ai_addr, addresses->ai_addrlen) == 0 && listen(listenFd, 64) == 0;
+  freeaddrinfo(addresses);
+  if (!listening) {
+    fprintf(stderr, "Cannot listen on %s: %s\n", listenOn.c_str(), strerror(errno));
+    if (listenFd >= 0) close(listenFd);
+    return 1;
+  }
+  printf("evoke cache server listening on %s:%s, serving %s\n", address.c_str(), port.c_str(), dir.c_str());
+  fflush(stdout);
+  // One request per connection, one connection at a time; the timeouts keep a stuck client from
+  // holding up everyone else for long.
+  while (true) {
+    int client = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (client < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      break;
+    }
+    SetTimeouts(client);
+    Serve(client, dir);
+    close(client);
+  }
+  close(listenFd);
+  return 1;
+}
+
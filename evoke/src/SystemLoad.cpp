@@ -0,0 +1,90 @@
+#include "SystemLoad.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sched.h>
+#include <string>
+
+static std::string OwnCgroup() {
+  // On a cgroup v2 host the unified hierarchy is the "0::" line.
+  std::ifstream in("/proc/self/cgroup");
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.compare(0, 3, "0::") == 0) return line.substr(3);
+  }
+  return "";
+}
+
+static size_t CgroupCpuLimit() {
+  std::string cgroup = OwnCgroup();
+  if (cgroup.empty()) return 0;
+  size_t limit = 0;
+  while (true) {
+    std::ifstream in("/sys/fs/cgroup" + cgroup + "/cpu.max");
+    std::string quota;
+    double period = 0;
+    if (in >> quota >> period && quota != "max" && period > 0) {
+      size_t cpus = std::max<size_t>(1, std::ceil(std::stod(quota) / period));
+      limit = limit ? std::min(limit, cpus) : cpus;
+    }
+    if (cgroup.empty() || cgroup == "/") break;
+    cgroup = cgroup.substr(0, cgroup.find_last_of('/'));
+  }
+  return limit;
+}
+
+size_t AvailableCpus() {
+  size_t cpus = 1;
+  cpu_set_t set;
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) cpus = std::max(1, CPU_COUNT(&set));
+  size_t limit = CgroupCpuLimit();
+  if (limit) cpus = std::min(cpus, limit);
+  return cpus;
+}
+
+uint64_t AvailableMemoryKb() {
+  uint64_t memory = 0;
+  std::ifstream meminfo("/proc/meminfo");
+  std::string key;
+  while (meminfo >> key) {
+    if (key == "MemTotal:") {
+      meminfo >> memory;
+      break;
+    }
+    meminfo.ignore(1024, '\n');
+  }
+  std::string cgroup = OwnCgroup();
+  while (!cgroup.empty()) {
+    std::ifstream in("/sys/fs/cgroup" + cgroup + "/memory.max");
+    std::string limit;
+    if (in >> limit && limit != "max") {
+      uint64_t kb = std::stoull(limit) / 1024;
+      if (!memory || kb < memory) memory = kb;
+    }
+    if (cgroup == "/") break;
+    cgroup = cgroup.substr(0, std::max<size_t>(cgroup.find_last_of('/'), 1));
+  }
+  return memory;
+}
+
+static bool ReadPressure(const char* filename, double& avg10) {
+  FILE* f = fopen(filename, "r");
+  if (!f) return false;
+  bool ok = fscanf(f, "some avg10=%lf", &avg10) == 1;
+  fclose(f);
+  return ok;
+}
+
+SystemLoad ReadSystemLoad() {
+  SystemLoad load;
+  load.hasPressure = ReadPressure("/proc/pressure/cpu", load.cpuPressure) &&
+                     ReadPressure("/proc/pressure/memory", load.memoryPressure);
+  FILE* f = fopen("/proc/loadavg", "r");
+  if (f) {
+    if (fscanf(f, "%lf", &load.loadAverage) != 1) load.loadAverage = 0;
+    fclose(f);
+  }
+  return load;
+}
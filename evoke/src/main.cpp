@@ -1,11 +1,17 @@
 #include "Project.h"
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
 #include <iostream>
 #include "Toolset.h"
 #include "values.h"
+#include "BuildLog.h"
 #include "Executor.h"
-#include <thread>
-#include <chrono>
-using namespace std::literals::chrono_literals;
+#include "SystemLoad.h"
+#include "Daemon.h"
+#include "ComponentCache.h"
+#include "ObjectCache.h"
+#include "RemoteCache.h"
 
 template <typename T>
 std::ostream& operator<<(std::ostream& os, std::vector<T> v) {
@@ -32,10 +38,80 @@ void parseArgs(std::vector<std::string> args, std::map<std::string, std::string&
   }
 }
 
+static bool ParseCount(const std::string& text, size_t& count) {
+  char* end;
+  errno = 0;
+  count = strtoul(text.c_str(), &end, 10);
+  return !text.empty() && isdigit(static_cast<unsigned char>(text[0])) && *end == 0 && errno == 0;
+}
+
+// Sizes are given like 6G or 512M; plain numbers are MB.
+static bool ParseSizeKb(const std::string& size, uint64_t& kb) {
+  char* end;
+  errno = 0;
+  kb = strtoull(size.c_str(), &end, 10) * 1024;
+  if (size.empty() || !isdigit(static_cast<unsigned char>(size[0])) || errno != 0) return false;
+  if (*end == 'G' || *end == 'g') {
+    kb *= 1024;
+    end++;
+  } else if (*end == 'M' || *end == 'm') {
+    end++;
+  }
+  return *end == 0;
+}
+
 int main(int argc, const char **argv) {
+  std::vector<std::string> args(argv+1, argv + argc);
+  if (!args.empty() && (args[0] == "build" || args[0] == "stop")) {
+    return RunClient(args[0]);
+  }
+  bool daemon = !args.empty() && args[0] == "--daemon";
+  if (daemon) args.erase(args.begin());
   std::string toolsetname = "ubuntu";
-  parseArgs(std::vector<std::string>(argv+1, argv + argc), { { "-t", toolsetname } });
-  Project op;
+  std::string scanThreads = "0";
+  std::string jobs = std::to_string(AvailableCpus());
+  std::string memoryBudget;
+  std::string staleness = "mtime";
+  std::string cacheDir = ".evoke/cache";
+  std::string cacheSize = "5G";
+  std::string remoteCache;
+  std::string cacheServer;
+  parseArgs(args, { { "-t", toolsetname }, { "--scan-threads", scanThreads }, { "-j", jobs }, { "--memory-budget", memoryBudget }, { "--staleness", staleness },
+                    { "--cache-dir", cacheDir }, { "--cache-size", cacheSize }, { "--remote-cache", remoteCache }, { "--cache-server", cacheServer } });
+  // --cache-server [address:]port serves the cache in --cache-dir to other machines instead of building.
+  if (!cacheServer.empty()) return RunCacheServer(cacheServer, cacheDir);
+  if (staleness != "mtime" && staleness != "content") {
+    std::cerr << "Invalid staleness mode " << staleness << ", expected mtime or content\n";
+    return 1;
+  }
+  // -j auto starts at the CPU count and adapts to the load on the machine.
+  bool adaptive = (jobs == "auto");
+  size_t jobCount = AvailableCpus(), scanThreadCount;
+  if (!adaptive && !ParseCount(jobs, jobCount)) {
+    std::cerr << "Invalid job count " << jobs << ", expected a number or auto\n";
+    return 1;
+  }
+  jobCount = std::max<size_t>(1, jobCount);
+  if (!ParseCount(scanThreads, scanThreadCount)) {
+    std::cerr << "Invalid scan thread count " << scanThreads << ", expected a number\n";
+    return 1;
+  }
+  // There is no memory budget unless one is given; --memory-budget auto uses the physical memory
+  // available to us.
+  uint64_t memoryBudgetKb = 0, cacheSizeKb = 0;
+  if (memoryBudget == "auto") {
+    memoryBudgetKb = AvailableMemoryKb();
+  } else if (!memoryBudget.empty() && !ParseSizeKb(memoryBudget, memoryBudgetKb)) {
+    std::cerr << "Invalid memory budget " << memoryBudget << ", expected a size like 512M or 6G, or auto\n";
+    return 1;
+  }
+  if (!ParseSizeKb(cacheSize, cacheSizeKb)) {
+    std::cerr << "Invalid cache size " << cacheSize << ", expected a size like 512M or 6G\n";
+    return 1;
+  }
+  Project op(scanThreadCount);
+  // --staleness content rebuilds only when an input's contents changed, not when it was merely touched.
+  op.manifest.contentHash = (staleness == "content");
   if (!op.unknownHeaders.empty()) {
     /*
       // TODO: allow building without package fetching somehow
@@ -51,20 +127,50 @@ int main(int argc, const char **argv) {
   }
 
   std::unique_ptr<Toolset> toolset = GetToolsetByName(toolsetname);
-  for (auto& c : values(op.components)) {
-    toolset->CreateCommandsFor(op, c);
-  }
-  Executor ex;
-  for (auto& comp : op.components) {
-    for (auto& c : comp.second.commands) {
-      if (c->state == PendingCommand::ToBeRun) 
-        ex.Run(c);
+  BuildLog log;
+  log.Load(".evoke/log");
+  // The object cache can be shared between checkouts with --cache-dir, and between machines with
+  // --remote-cache http://host:port/path; --cache-size 0 turns it off.
+  std::unique_ptr<ObjectCache> cache;
+  if (cacheSizeKb) cache = std::make_unique<ObjectCache>(cacheDir, cacheSizeKb * 1024, remoteCache);
+  auto build = [&op, &toolset, &log, &cache, jobCount, adaptive, memoryBudgetKb] {
+    for (auto& c : values(op.components)) {
+      toolset->CreateCommandsFor(op, c);
     }
-  }
-  ex.Start();
-  while (ex.Busy()) { std::this_thread::sleep_for(1s); }
-  printf("\n\n");
-  return 0;
+    // Packages that are current or cached are settled before any of their commands is looked at.
+    std::unique_ptr<ComponentCache> packages;
+    if (cache) {
+      packages = std::make_unique<ComponentCache>(op, *cache);
+      packages->Restore();
+    }
+    op.CheckCommands();
+    Executor ex(log, cache.get(), jobCount, adaptive, memoryBudgetKb);
+    for (auto& comp : op.components) {
+      for (auto& c : comp.second.commands) {
+        if (c->state == PendingCommand::ToBeRun) 
+          ex.Run(c);
+      }
+    }
+    ex.Start();
+    ex.Wait();
+    if (packages) packages->Store();
+    op.manifest.Save(".evoke/manifest");
+    printf("\n\n");
+    if (cache) {
+      cache->Trim();
+      cache->PrintStatistics();
+      packages->PrintStatistics();
+    }
+    for (auto& comp : op.components) {
+      for (auto& c : comp.second.commands) {
+        if (c->state != PendingCommand::Done) return 1;
+        for (auto& o : c->outputs) {
+          if (o->state == File::Error) return 1;
+        }
+      }
+    }
+    return 0;
+  };
+  if (daemon) return RunDaemon(op, build);
+  return build();
 }
-
-
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// 64-bit FNV-1a. Not cryptographic; used for record checksums and for keying commands across runs,
+// so the value must stay stable between versions.
+inline uint64_t Fnv1a(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL) {
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  for (size_t n = 0; n < size; n++) {
+    hash = (hash ^ p[n]) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+inline uint64_t Fnv1a(std::string_view str) {
+  return Fnv1a(str.data(), str.size());
+}
+
+// XXH64, for hashing file contents. Matches the reference implementation bit for bit.
+uint64_t Xxh64(const void* data, size_t size, uint64_t seed = 0);
+
+// Hashes the contents of a file with Xxh64. Returns false if it cannot be read.
+bool HashFileContents(const std::string& path, uint64_t& hash);
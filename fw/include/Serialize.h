@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Little helpers for the binary caches in .evoke. Reading past the end clears ok instead of
+// throwing, so callers can check once after reading a whole record.
+struct Reader {
+  const char* p;
+  const char* end;
+  bool ok = true;
+  template <typename T>
+  T Read() {
+    T value{};
+    if (static_cast<size_t>(end - p) < sizeof(T)) {
+      ok = false;
+      return value;
+    }
+    memcpy(&value, p, sizeof(T));
+    p += sizeof(T);
+    return value;
+  }
+  std::string_view ReadString() {
+    uint32_t length = Read<uint32_t>();
+    if (!ok || static_cast<size_t>(end - p) < length) {
+      ok = false;
+      return {};
+    }
+    std::string_view s(p, length);
+    p += length;
+    return s;
+  }
+};
+
+struct Writer {
+  std::vector<char>& out;
+  template <typename T>
+  void Write(T value) {
+    out.insert(out.end(), reinterpret_cast<const char*>(&value), reinterpret_cast<const char*>(&value) + sizeof(T));
+  }
+  void WriteString(const std::string& s) {
+    Write<uint32_t>(s.size());
+    out.insert(out.end(), s.begin(), s.end());
+  }
+};
@@ -0,0 +1,103 @@
+#include "Hash.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint64_t prime1 = 11400714785074694791ULL;
+static const uint64_t prime2 = 14029467366897019727ULL;
+static const uint64_t prime3 = 1609587929392839161ULL;
+static const uint64_t prime4 = 9650029242287828579ULL;
+static const uint64_t prime5 = 2870177450012600261ULL;
+
+static inline uint64_t Rotl(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t Read64(const unsigned char* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint32_t Read32(const unsigned char* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t Round(uint64_t acc, uint64_t input) {
+  acc += input * prime2;
+  acc = Rotl(acc, 31);
+  return acc * prime1;
+}
+
+static inline uint64_t MergeRound(uint64_t acc, uint64_t val) {
+  acc ^= Round(0, val);
+  return acc * prime1 + prime4;
+}
+
+uint64_t Xxh64(const void* data, size_t size, uint64_t seed) {
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  const unsigned char* end = p + size;
+  uint64_t h;
+  if (size >= 32) {
+    uint64_t v1 = seed + prime1 + prime2, v2 = seed + prime2, v3 = seed, v4 = seed - prime1;
+    do {
+      v1 = Round(v1, Read64(p));
+      v2 = Round(v2, Read64(p + 8));
+      v3 = Round(v3, Read64(p + 16));
+      v4 = Round(v4, Read64(p + 24));
+      p += 32;
+    } while (end - p >= 32);
+    h = Rotl(v1, 1) + Rotl(v2, 7) + Rotl(v3, 12) + Rotl(v4, 18);
+    h = MergeRound(h, v1);
+    h = MergeRound(h, v2);
+    h = MergeRound(h, v3);
+    h = MergeRound(h, v4);
+  } else {
+    h = seed + prime5;
+  }
+  h += size;
+  for (; end - p >= 8; p += 8) {
+    h ^= Round(0, Read64(p));
+    h = Rotl(h, 27) * prime1 + prime4;
+  }
+  if (end - p >= 4) {
+    h ^= uint64_t(Read32(p)) * prime1;
+    h = Rotl(h, 23) * prime2 + prime3;
+    p += 4;
+  }
+  for (; p != end; p++) {
+    h ^= *p * prime5;
+    h = Rotl(h, 11) * prime1;
+  }
+  h ^= h >> 33;
+  h *= prime2;
+  h ^= h >> 29;
+  h *= prime3;
+  h ^= h >> 32;
+  return h;
+}
+
+bool HashFileContents(const std::string& path, uint64_t& hash) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+  if (st.st_size == 0) {
+    close(fd);
+    hash = Xxh64(nullptr, 0);
+    return true;
+  }
+  void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) return false;
+  hash = Xxh64(p, st.st_size);
+  munmap(p, st.st_size);
+  return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Bump allocator for graph objects that all die together. Deallocation is a no-op; Release()
+// runs the destructors registered by Create() and returns every chunk at once.
+// Not thread safe. EVOKE_HUGEPAGES=1 backs chunks with huge pages where the kernel allows it.
+class Arena : public std::pmr::memory_resource {
+public:
+  Arena();
+  ~Arena();
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+  template <typename T, typename... Args>
+  T* Create(Args&&... args) {
+    T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    if (!std::is_trivially_destructible<T>::value) {
+      Destructor* d = new (allocate(sizeof(Destructor), alignof(Destructor))) Destructor{ [](void* p) { static_cast<T*>(p)->~T(); }, object, destructors };
+      destructors = d;
+    }
+    return object;
+  }
+  void Release();
+  size_t BytesAllocated() const { return allocated; }
+  size_t BytesDiscarded() const { return discarded; }
+  size_t BytesReserved() const { return reserved; }
+private:
+  void* do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void*, size_t bytes, size_t) override { discarded += bytes; }
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+  struct Chunk {
+    Chunk* next;
+    size_t size;
+  };
+  struct Destructor {
+    void (*destroy)(void*);
+    void* object;
+    Destructor* next;
+  };
+  Chunk* chunks = nullptr;
+  Destructor* destructors = nullptr;
+  char* current = nullptr;
+  char* end = nullptr;
+  size_t allocated = 0, discarded = 0, reserved = 0;
+};
+
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+// What evoke knows about the outputs it built, keyed by output path. Kept in .evoke/manifest and
+// consulted by PendingCommand::Check in addition to timestamps. Lookups and updates may come from
+// several threads; records handed out stay where they are until the next Load or Retain.
+struct BuildManifest {
+public:
+  struct Output {
+    // Hash of the command line that produced the output.
+    uint64_t commandHash = 0;
+    // Digest of the contents of the inputs it was built from, in content-hash mode. 0 if unknown.
+    uint64_t inputsDigest = 0;
+    // Hash of the output's contents when it was last built, to tell whether a rebuild changed it.
+    uint64_t outputHash = 0;
+    // For a component's archive: the key it was stored or restored under in the component cache.
+    uint64_t componentKey = 0;
+  };
+  // Last seen state of a file whose contents were hashed.
+  struct Input {
+    int64_t mtimeNs = 0;
+    uint64_t size = 0;
+    uint64_t hash = 0;
+  };
+  void Load(const std::string& filename);
+  void Save(const std::string& filename);
+  const Output* Find(const std::string& path);
+  Output& Get(const std::string& path);
+  void Forget(const std::string& path);
+  // Drops the records of all paths not in live, so that renamed and deleted files do not keep
+  // growing the manifest.
+  void Retain(const std::unordered_set<std::string>& live);
+  // Xxh64 of the file's contents. The file is only read again when its mtime or size changed
+  // since it was last hashed; returns 0 if it does not exist.
+  uint64_t ContentHash(const std::string& path);
+  // The same, for a file whose mtime and size are already known.
+  uint64_t ContentHash(const std::string& path, int64_t mtimeNs, uint64_t size);
+  // Set to decide staleness on input contents instead of timestamps.
+  bool contentHash = false;
+private:
+  std::mutex m;
+  std::unordered_map<std::string, Output> outputs;
+  std::unordered_map<std::string, Input> inputs;
+  bool changed = false;
+};
+
@@ -10,6 +10,7 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
+#include "Name.h"
 
 struct File;
 struct PendingCommand;
@@ -17,14 +18,13 @@ struct PendingCommand;
 struct Component {
 public:
   Component(const boost::filesystem::path &path, bool isBinary = false);
-  ~Component();
   std::string GetName() const;
   bool isHeaderOnly() const;
   boost::filesystem::path root;
   std::unordered_set<File *> files;
   std::vector<PendingCommand*> commands;
   std::unordered_set<Component *> pubDeps, privDeps;
-  std::unordered_set<std::string> pubIncl, privIncl;
+  std::unordered_set<Name> pubIncl, privIncl;
   std::string type;
   bool buildSuccess;
   bool isBinary;
@@ -0,0 +1,9 @@
+#pragma once
+
+// Returns a pointer to the first '#', ';' or '/' in [p, end), or end if there is none.
+// These are the only bytes that can move ReadCodeFrom out of its idle state.
+using DirectiveScanner = const char* (*)(const char* p, const char* end);
+
+DirectiveScanner GetDirectiveScanner();
+const char* GetDirectiveScannerName();
+
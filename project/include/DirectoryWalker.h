@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct DirectoryWalker {
+public:
+  struct Entry {
+    std::string path;
+    bool isDirectory = false;
+    bool isRegularFile = false;
+    bool hasIncludeDir = false;
+    bool hasSrcDir = false;
+    bool hasTestDir = false;
+    // Modification time in nanoseconds and size of the regular files wantsMetadata picked, taken
+    // during the walk so that nothing needs to stat them again.
+    int64_t mtimeNs = 0;
+    uint64_t size = 0;
+  };
+  // Regular files are only statted when wantsMetadata returns true for their name.
+  DirectoryWalker(size_t threadCount, std::function<bool(const std::string& path, const std::string& name)> prune,
+                  std::function<bool(const std::string& name)> wantsMetadata = nullptr);
+  std::vector<Entry> Walk(const std::string& root);
+  size_t threadCount;
+private:
+  std::function<bool(const std::string& path, const std::string& name)> prune;
+  std::function<bool(const std::string& name)> wantsMetadata;
+};
+
@@ -1,16 +1,23 @@
 #pragma once
 
 #include <boost/filesystem.hpp>
+#include <fcntl.h>
+#include <memory_resource>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <sys/stat.h>
 #include "Component.h"
+#include "Name.h"
 struct Component;
 
 struct File {
 private:
-  File(const boost::filesystem::path& path, Component& component)
+  File(const boost::filesystem::path& path, Component& component, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
   : path(path)
+  , dependencies(resource)
+  , includers(resource)
+  , includePaths(resource)
   , component(component)
   , hasExternalInclude(false)
   , hasInclude(false)
@@ -18,7 +25,7 @@ private:
   }
   friend class Project;
   void AddIncludeStmt(bool withPointyBrackets, const std::string& filename) {
-      rawIncludes.insert(std::make_pair(filename, withPointyBrackets));
+      rawIncludes.insert(std::make_pair(Name(filename), withPointyBrackets));
   }
   void SetModule(const std::string& moduleName, bool exported) {
     this->moduleName = moduleName;
@@ -32,21 +39,43 @@ private:
     }
   }
 public:
-  std::time_t lastwrite() {
-    if (lastwrite_ == 0) {
-      boost::system::error_code ec;
-      lastwrite_ = boost::filesystem::last_write_time(path, ec);
+  // Modification time in nanoseconds, or 0 if the file does not exist. Sources get their metadata
+  // from the directory walk and outputs from the batch in Project::CheckCommands, so this only
+  // has to stat files nobody looked at yet.
+  int64_t lastwrite() {
+    if (!statted) Stat();
+    return mtimeNs;
+  }
+  void Stat() {
+    struct statx stx;
+    if (statx(AT_FDCWD, path.c_str(), 0, STATX_MTIME | STATX_SIZE, &stx) == 0) {
+      SetMetadata(stx.stx_mtime.tv_sec * 1000000000LL + stx.stx_mtime.tv_nsec, stx.stx_size);
+    } else {
+      SetMetadata(0, 0);
     }
-    return lastwrite_;
   }
-  std::time_t lastwrite_ = 0;
+  void SetMetadata(int64_t mtime, uint64_t fileSize) {
+    mtimeNs = mtime;
+    size = fileSize;
+    statted = true;
+  }
+  // For files that were just written; the next lastwrite() looks again.
+  void Invalidate() {
+    statted = false;
+  }
+  bool statted = false;
+  int64_t mtimeNs = 0;
+  uint64_t size = 0;
+  // mtime of an output before its generator rewrote or touched it in this build; 0 if unknown.
+  int64_t previousMtimeNs = 0;
   boost::filesystem::path path;
   std::string moduleName;
   bool moduleExported = false;
   std::unordered_map<std::string, bool> imports;
-  std::unordered_map<std::string, bool> rawIncludes;
-  std::unordered_set<File *> dependencies;
-  std::unordered_set<std::string> includePaths;
+  std::unordered_map<Name, bool> rawIncludes;
+  std::pmr::unordered_set<File *> dependencies;
+  std::pmr::unordered_set<File *> includers;
+  std::pmr::unordered_set<Name> includePaths;
   PendingCommand* generator = nullptr;
   std::vector<PendingCommand*> listeners;
   Component &component;
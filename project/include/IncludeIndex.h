@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct File;
+
+// Include spellings and paths are matched case-insensitively, after going through this.
+std::string Lowercase(const std::string& str);
+
+// Maps every trailing run of path components (lowercased) to the files whose path ends in it.
+// Paths are stored as a trie over reversed components, keyed by the components' Name ids.
+struct IncludeIndex {
+public:
+  enum Result {
+    NotFound,
+    Unique,
+    Ambiguous,
+  };
+  IncludeIndex();
+  void Clear();
+  void Add(File* file, const std::string& path);
+  void Remove(File* file, const std::string& path);
+  Result Find(const std::string& spelling, File*& file) const;
+private:
+  struct Node {
+    File* file = nullptr;
+    uint32_t count = 0;
+  };
+  static std::vector<std::string_view> ReversedComponents(const std::string& lowercasePath);
+  uint32_t Child(uint32_t parent, uint32_t name) const;
+  std::unordered_map<uint64_t, uint32_t> edges;
+  std::vector<Node> nodes;
+  std::unordered_map<uint32_t, std::vector<File*>> collisions;
+};
+
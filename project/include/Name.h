@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Process-wide table of unique strings. Entries are never freed, so ids handed out stay valid
+// for the lifetime of the process and can be read from any thread without locking.
+class StringTable {
+public:
+  static StringTable& Instance();
+  uint32_t Intern(std::string_view str);
+  // Returns false if str was never interned; used for lookups that should not grow the table.
+  bool Find(std::string_view str, uint32_t& id) const;
+  const std::string& Get(uint32_t id) const {
+    uint32_t biased = id + firstSegmentSize;
+    int segment = 31 - __builtin_clz(biased) - firstSegmentBits;
+    return segments[segment].load(std::memory_order_acquire)[biased - (firstSegmentSize << segment)];
+  }
+  size_t Count() const;
+  size_t Bytes() const;
+private:
+  StringTable();
+  // Segment n holds firstSegmentSize << n strings, so a lookup is a shift and two loads.
+  static const uint32_t firstSegmentBits = 10, firstSegmentSize = 1 << firstSegmentBits;
+  mutable std::shared_mutex mutex;
+  std::unordered_map<std::string_view, uint32_t> ids;
+  std::atomic<std::string*> segments[32 - firstSegmentBits] = {};
+  size_t bytes = 0;
+};
+
+// An interned string. Compares and hashes as its 32-bit id; id 0 is the empty string.
+struct Name {
+  Name() = default;
+  explicit Name(std::string_view str)
+  : id(StringTable::Instance().Intern(str))
+  {}
+  static bool Find(std::string_view str, Name& name) {
+    return StringTable::Instance().Find(str, name.id);
+  }
+  const std::string& str() const {
+    return StringTable::Instance().Get(id);
+  }
+  explicit operator const std::string&() const {
+    return str();
+  }
+  bool operator==(const Name& other) const { return id == other.id; }
+  bool operator!=(const Name& other) const { return id != other.id; }
+  uint32_t id = 0;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const Name& name) {
+  return os << name.str();
+}
+
+namespace std {
+template <>
+struct hash<Name> {
+  size_t operator()(const Name& name) const { return name.id; }
+};
+}
+
@@ -1,28 +1,62 @@
 #pragma once
 
+#include <memory_resource>
 #include <vector>
 #include <string>
 #include <ostream>
 #include "File.h"
 
+struct BuildManifest;
+
 struct PendingCommand {
 public:
-  PendingCommand(const std::string& command);
+  PendingCommand(const std::string& command, BuildManifest* manifest = nullptr, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
   void AddInput(File* input);
   void AddOutput(File* output);
-  std::vector<File*> inputs;
-  std::vector<File*> outputs;
+  std::pmr::vector<File*> inputs;
+  std::pmr::vector<File*> outputs;
+  // Decides whether the command has to run. The generators of all inputs must have been checked
+  // already; Project::CheckCommands takes care of the order.
   void Check();
 public:
   std::string commandToRun;
+  uint64_t commandHash;
+  BuildManifest* manifest;
+  // Set by toolsets on commands whose output depends only on the command line and the contents of
+  // the inputs, such as compiles, so the output can be taken from the object cache.
+  bool cacheable = false;
   enum State {
     Unknown,
     ToBeRun,
     Running,
     Done
   } state = Unknown;
+  // Stats and hashes the outputs of a command that just finished. This reads whole files, so the
+  // executor calls it outside its lock and SetResult only records what it found.
+  void HashOutputs(bool success);
+  std::vector<uint64_t> outputHashes;
   void SetResult(bool success);
-  bool CanRun();
+  // Called once all inputs are built: true if they came out the same as in the build that made the
+  // current outputs, so running the command would only reproduce them.
+  bool CanSkip();
+  // Marks the command done without running it.
+  void Skip();
+  // Set when the command ran or was skipped in this build; outputsChanged tells whether any output
+  // differs from the previous build, which is what lets consumers be skipped in turn.
+  bool rebuilt = false;
+  bool outputsChanged = false;
+  // Order-independent hash over the paths and contents of all inputs; only valid with a manifest.
+  uint64_t InputsDigest() const;
+  // InputsDigest() as it was just before the command started, which is what SetResult records.
+  // Taken later, it could describe sources saved while the command was running.
+  uint64_t inputsDigest = 0;
+  // Number of inputs that still have to be built before this command can run.
+  size_t CountBlockedInputs() const;
+  size_t blockedInputs = 0;
+  // Expected time in microseconds from starting this command to the end of the longest chain of commands waiting on it.
+  uint64_t criticalPath = 0;
+  uint64_t expectedDuration = 0;
+  uint64_t expectedRssKb = 0;
 };
 
 std::ostream& operator<<(std::ostream& os, const PendingCommand&);
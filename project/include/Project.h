@@ -4,37 +4,74 @@
 #include <unordered_map>
 #include <string>
 #include <ostream>
+#include "Arena.h"
+#include "BuildManifest.h"
 #include "Component.h"
 #include "File.h"
+#include "IncludeIndex.h"
 #include "PendingCommand.h"
+#include "ScanCache.h"
 
 class Project {
 public:
-  Project();
+  Project(size_t scanThreads = 0);
   ~Project();
   void Reload();
+  void Reload(const std::set<std::string>& added, const std::set<std::string>& removed, const std::set<std::string>& modified);
+  void ClearCommands();
+  File* FindFile(const std::string& path);
   File* CreateFile(Component& c, boost::filesystem::path p);
+  PendingCommand* CreateCommand(const std::string& command);
+  // Checks every command once, after the commands generating its inputs.
+  void CheckCommands();
   boost::filesystem::path projectRoot;
+  size_t scanThreads;
+  // Source files and their edges live in graphArena until the next full Reload. Commands and the
+  // files they generate live in commandArena until the next ClearCommands.
+  Arena graphArena, commandArena;
+  BuildManifest manifest;
   std::unordered_map<std::string, Component> components;
   std::unordered_set<std::string> unknownHeaders;
-  std::unordered_map<std::string, File> files;
+  std::pmr::unordered_map<Name, File> files{&graphArena};
+  std::pmr::unordered_map<Name, File> generatedFiles{&commandArena};
   std::vector<PendingCommand*> buildPipeline;
   std::unordered_map<std::string, std::vector<std::string>> ambiguous;
 
   bool IsCompilationUnit(const std::string& ext);
   bool IsCode(const std::string &ext);
+  bool IsItemBlacklisted(const boost::filesystem::path &path);
 private:
   void LoadFileList();
-  void MapIncludesToDependencies(std::unordered_map<std::string, std::string> &includeLookup,
-                                 std::unordered_map<std::string, std::vector<std::string>> &ambiguous);
+  void MapIncludesToDependencies();
+  void ResolveIncludes(File& f, bool updateComponent);
+  void UnresolveIncludes(File& f);
   void PropagateExternalIncludes();
+  void PropagateExternalIncludes(Component& comp);
   void ExtractPublicDependencies();
+  void ExtractPublicDependencies(Component& comp);
   void ExtractIncludePaths();
-  void CreateIncludeLookupTable(std::unordered_map<std::string, std::string> &includeLookup,
-                                std::unordered_map<std::string, std::set<std::string>> &collisions);
+  void ExtractIncludePaths(Component& comp);
+  void CreateIncludeLookupTable();
+  void ReportNameUsage();
   void ReadCodeFrom(File& f, const char* buffer, size_t buffersize);
-  void ReadCode(std::unordered_map<std::string, File>& files, const boost::filesystem::path &path, Component& comp);
-  bool IsItemBlacklisted(const boost::filesystem::path &path);
+  // Parses f unless the scan cache has it. Uses f's metadata when it is already known, and
+  // leaves it describing the contents that were read.
+  bool ReadCode(File& f, const std::string& path);
+  ScanCache scanCache;
+  struct Resolution {
+    enum Kind {
+      Local,
+      Unique,
+      Ambiguous,
+      NotFound,
+    } kind;
+    File* file;
+    Component* predef;
+  };
+  const Resolution& Resolve(const std::string& dir, const std::string& spelling, bool pointyBrackets);
+  IncludeIndex includeIndex;
+  std::unordered_map<std::string, Resolution> resolutions;
+  std::unordered_map<std::string, std::unordered_set<File*>> includersByName;
   friend std::ostream& operator<<(std::ostream& os, const Project& p);
 };
 
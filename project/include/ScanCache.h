@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+struct File;
+
+struct ScanCache {
+public:
+  ScanCache() = default;
+  ~ScanCache();
+  ScanCache(const ScanCache&) = delete;
+  ScanCache& operator=(const ScanCache&) = delete;
+  void Load(const std::string& filename);
+  void Save(const std::string& filename);
+  bool Apply(File& f, const std::string& path, uint64_t size, int64_t mtime) const;
+  void Store(File& f, const std::string& path, uint64_t size, int64_t mtime, bool wasHit);
+  void Forget(const std::string& path);
+  size_t hits = 0, misses = 0;
+private:
+  struct Stamp {
+    uint64_t size;
+    int64_t mtime;
+    File* file;
+  };
+  void Unmap();
+  const char* mapping = nullptr;
+  size_t mappingSize = 0;
+  std::unordered_map<std::string_view, const char*> records;
+  std::unordered_map<std::string, Stamp> fresh;
+};
+
@@ -0,0 +1,64 @@
+#include "Arena.h"
+#include <cstdint>
+#include <cstdlib>
+#include <sys/mman.h>
+
+static const size_t chunkSize = 2 << 20;
+
+static bool UseHugePages() {
+  static bool enabled = [] {
+    const char* env = getenv("EVOKE_HUGEPAGES");
+    return env && env[0] == '1';
+  }();
+  return enabled;
+}
+
+Arena::Arena() {
+}
+
+Arena::~Arena() {
+  Release();
+}
+
+void* Arena::do_allocate(size_t bytes, size_t alignment) {
+  char* p = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(current) + alignment - 1) & ~(uintptr_t(alignment) - 1));
+  if (!current || p + bytes > end) {
+    // Oversized requests get a chunk of their own; the current chunk keeps serving small ones.
+    size_t size = (sizeof(Chunk) + alignment + bytes + chunkSize - 1) / chunkSize * chunkSize;
+    void* memory = MAP_FAILED;
+    if (UseHugePages()) memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (memory == MAP_FAILED) {
+      memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (memory == MAP_FAILED) throw std::bad_alloc();
+      if (UseHugePages()) madvise(memory, size, MADV_HUGEPAGE);
+    }
+    Chunk* chunk = new (memory) Chunk{chunks, size};
+    chunks = chunk;
+    reserved += size;
+    char* start = reinterpret_cast<char*>(chunk + 1);
+    p = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(start) + alignment - 1) & ~(uintptr_t(alignment) - 1));
+    if (reinterpret_cast<char*>(memory) + size - (p + bytes) > end - current) {
+      current = p + bytes;
+      end = reinterpret_cast<char*>(memory) + size;
+    }
+    allocated += bytes;
+    return p;
+  }
+  current = p + bytes;
+  allocated += bytes;
+  return p;
+}
+
+void Arena::Release() {
+  for (Destructor* d = destructors; d; d = d->next) {
+    d->destroy(d->object);
+  }
+  destructors = nullptr;
+  while (chunks) {
+    Chunk* next = chunks->next;
+    munmap(chunks, chunks->size);
+    chunks = next;
+  }
+  current = end = nullptr;
+  allocated = discarded = reserved = 0;
+}
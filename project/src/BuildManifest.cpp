@@ -0,0 +1,179 @@
+#include "BuildManifest.h"
+#include "Hash.h"
+#include "Serialize.h"
+#include <boost/filesystem.hpp>
+#include <cstdio>
+#include <ctime>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Layout: magic, then records of [u32 body length][u64 checksum of body][body].
+// A body starts with a tag: 'O' for an output path, the hash of the command that produced it, the
+// digest of its inputs, the hash of its contents and its component cache key, or 'I' for a hashed file with its mtime, size and content hash.
+static const char magic[8] = { 'E', 'V', 'K', 'M', 'A', 'N', 'I', '4' };
+
+void BuildManifest::Load(const std::string& filename) {
+  outputs.clear();
+  inputs.clear();
+  changed = false;
+  FILE* file = fopen(filename.c_str(), "rb");
+  if (!file) return;
+  std::vector<char> contents;
+  char buffer[65536];
+  size_t bread;
+  while ((bread = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    contents.insert(contents.end(), buffer, buffer + bread);
+  }
+  fclose(file);
+  if (contents.size() < sizeof(magic) || memcmp(contents.data(), magic, sizeof(magic)) != 0) {
+    // Manifests from older versions only cost the history; outputs are adopted again.
+    if (contents.size() >= sizeof(magic) && memcmp(contents.data(), magic, sizeof(magic) - 1) == 0) return;
+    fprintf(stderr, "Build manifest %s has an unknown format, ignoring it\n", filename.c_str());
+    return;
+  }
+  Reader r{contents.data() + sizeof(magic), contents.data() + contents.size()};
+  while (r.p != r.end) {
+    uint32_t length = r.Read<uint32_t>();
+    uint64_t checksum = r.Read<uint64_t>();
+    if (!r.ok || static_cast<size_t>(r.end - r.p) < length || Fnv1a(r.p, length) != checksum) {
+      // Outputs without a record are taken as they are, so losing the rest only loses history.
+      fprintf(stderr, "Build manifest %s is corrupt at offset %zu, ignoring the rest\n", filename.c_str(), r.p - contents.data());
+      return;
+    }
+    Reader body{r.p, r.p + length};
+    r.p += length;
+    char tag = body.Read<char>();
+    std::string path(body.ReadString());
+    if (tag == 'O') {
+      Output output;
+      output.commandHash = body.Read<uint64_t>();
+      output.inputsDigest = body.Read<uint64_t>();
+      output.outputHash = body.Read<uint64_t>();
+      output.componentKey = body.Read<uint64_t>();
+      if (body.ok) outputs[path] = output;
+    } else if (tag == 'I') {
+      Input input;
+      input.mtimeNs = body.Read<int64_t>();
+      input.size = body.Read<uint64_t>();
+      input.hash = body.Read<uint64_t>();
+      if (body.ok) inputs[path] = input;
+    }
+  }
+}
+
+void BuildManifest::Save(const std::string& filename) {
+  if (!changed) return;
+  std::vector<char> out(magic, magic + sizeof(magic));
+  std::vector<char> body;
+  auto writeRecord = [&out, &body] {
+    Writer f{out};
+    f.Write<uint32_t>(body.size());
+    f.Write<uint64_t>(Fnv1a(body.data(), body.size()));
+    out.insert(out.end(), body.begin(), body.end());
+  };
+  for (auto& o : outputs) {
+    body.clear();
+    Writer w{body};
+    w.Write<char>('O');
+    w.WriteString(o.first);
+    w.Write<uint64_t>(o.second.commandHash);
+    w.Write<uint64_t>(o.second.inputsDigest);
+    w.Write<uint64_t>(o.second.outputHash);
+    w.Write<uint64_t>(o.second.componentKey);
+    writeRecord();
+  }
+  for (auto& i : inputs) {
+    body.clear();
+    Writer w{body};
+    w.Write<char>('I');
+    w.WriteString(i.first);
+    w.Write<int64_t>(i.second.mtimeNs);
+    w.Write<uint64_t>(i.second.size);
+    w.Write<uint64_t>(i.second.hash);
+    writeRecord();
+  }
+
+  boost::system::error_code ec;
+  boost::filesystem::create_directories(boost::filesystem::path(filename).parent_path(), ec);
+  std::string tmpname = filename + ".tmp";
+  FILE* file = fopen(tmpname.c_str(), "wb");
+  if (!file) {
+    fprintf(stderr, "Cannot write build manifest %s\n", tmpname.c_str());
+    return;
+  }
+  bool written = fwrite(out.data(), 1, out.size(), file) == out.size();
+  written = (fclose(file) == 0) && written;
+  if (!written || rename(tmpname.c_str(), filename.c_str()) != 0) {
+    fprintf(stderr, "Cannot write build manifest %s\n", filename.c_str());
+    unlink(tmpname.c_str());
+    return;
+  }
+  changed = false;
+}
+
+const BuildManifest::Output* BuildManifest::Find(const std::string& path) {
+  std::lock_guard<std::mutex> l(m);
+  auto it = outputs.find(path);
+  return it == outputs.end() ? nullptr : &it->second;
+}
+
+BuildManifest::Output& BuildManifest::Get(const std::string& path) {
+  std::lock_guard<std::mutex> l(m);
+  changed = true;
+  return outputs[path];
+}
+
+void BuildManifest::Forget(const std::string& path) {
+  std::lock_guard<std::mutex> l(m);
+  if (outputs.erase(path)) changed = true;
+}
+
+void BuildManifest::Retain(const std::unordered_set<std::string>& live) {
+  std::lock_guard<std::mutex> l(m);
+  for (auto it = outputs.begin(); it != outputs.end();) {
+    if (live.count(it->first)) {
+      ++it;
+    } else {
+      it = outputs.erase(it);
+      changed = true;
+    }
+  }
+  for (auto it = inputs.begin(); it != inputs.end();) {
+    if (live.count(it->first)) {
+      ++it;
+    } else {
+      it = inputs.erase(it);
+      changed = true;
+    }
+  }
+}
+
+uint64_t BuildManifest::ContentHash(const std::string& path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) return 0;
+  return ContentHash(path, int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec, st.st_size);
+}
+
+uint64_t BuildManifest::ContentHash(const std::string& path, int64_t mtimeNs, uint64_t size) {
+  if (mtimeNs == 0) return 0;
+  {
+    std::lock_guard<std::mutex> l(m);
+    auto it = inputs.find(path);
+    if (it != inputs.end() && it->second.mtimeNs == mtimeNs && it->second.size == size) return it->second.hash;
+  }
+  uint64_t hash;
+  if (!HashFileContents(path, hash)) return 0;
+  // 0 means unknown, so a file that really hashes to it is nudged off it.
+  if (hash == 0) hash = 1;
+  // A file written just now can change again without its mtime moving on filesystems with coarse
+  // timestamps, so its hash is only reused once the file is older than that.
+  timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  std::lock_guard<std::mutex> l(m);
+  Input& input = inputs[path];
+  input.mtimeNs = (now.tv_sec - mtimeNs / 1000000000 < 2) ? 0 : mtimeNs;
+  input.size = size;
+  input.hash = hash;
+  changed = true;
+  return hash;
+}
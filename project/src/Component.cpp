@@ -20,10 +20,6 @@ Component::Component(const boost::filesystem::path &path, bool isBinary)
   root = rp;
 }
 
-Component::~Component() {
-  for (auto& c : commands) delete c;
-}
-
 bool Component::isHeaderOnly() const {
     if (isBinary) return false;
     for (auto& d : files) {
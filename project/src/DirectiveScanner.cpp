@@ -0,0 +1,79 @@
+#include "DirectiveScanner.h"
+#include <cstdlib>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EVOKE_X86 1
+#endif
+
+static const char* ScanScalar(const char* p, const char* end) {
+  for (; p != end; ++p) {
+    if (*p == '#' || *p == ';' || *p == '/') return p;
+  }
+  return end;
+}
+
+#ifdef EVOKE_X86
+__attribute__((target("sse2")))
+static const char* ScanSse2(const char* p, const char* end) {
+  const __m128i hash = _mm_set1_epi8('#'), semicolon = _mm_set1_epi8(';'), slash = _mm_set1_epi8('/');
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, hash), _mm_cmpeq_epi8(v, semicolon)), _mm_cmpeq_epi8(v, slash));
+    unsigned mask = _mm_movemask_epi8(m);
+    if (mask) return p + __builtin_ctz(mask);
+    p += 16;
+  }
+  return ScanScalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char* ScanAvx2(const char* p, const char* end) {
+  const __m256i hash = _mm256_set1_epi8('#'), semicolon = _mm256_set1_epi8(';'), slash = _mm256_set1_epi8('/');
+  while (end - p >= 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, hash), _mm256_cmpeq_epi8(v, semicolon)), _mm256_cmpeq_epi8(v, slash));
+    unsigned mask = _mm256_movemask_epi8(m);
+    if (mask) return p + __builtin_ctz(mask);
+    p += 32;
+  }
+  return ScanSse2(p, end);
+}
+#endif
+
+namespace {
+
+struct Choice {
+  DirectiveScanner scanner;
+  const char* name;
+};
+
+Choice Choose() {
+  // EVOKE_SCANNER=scalar|sse2|avx2 forces a specific implementation, for comparing throughput.
+  const char* forced = getenv("EVOKE_SCANNER");
+  if (forced && strcmp(forced, "scalar") == 0) return { ScanScalar, "scalar" };
+#ifdef EVOKE_X86
+  __builtin_cpu_init();
+  bool avx2 = __builtin_cpu_supports("avx2");
+  bool sse2 = __builtin_cpu_supports("sse2");
+  if (forced && strcmp(forced, "sse2") == 0 && sse2) return { ScanSse2, "sse2" };
+  if (avx2 && (!forced || strcmp(forced, "avx2") == 0)) return { ScanAvx2, "avx2" };
+  if (sse2) return { ScanSse2, "sse2" };
+#endif
+  return { ScanScalar, "scalar" };
+}
+
+const Choice& Chosen() {
+  static Choice choice = Choose();
+  return choice;
+}
+
+}
+
+DirectiveScanner GetDirectiveScanner() {
+  return Chosen().scanner;
+}
+
+const char* GetDirectiveScannerName() {
+  return Chosen().name;
+}
@@ -0,0 +1,164 @@
+#include "DirectoryWalker.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <dirent.h>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/stat.h>
+#include <thread>
+
+namespace {
+
+struct WorkQueue {
+  std::mutex m;
+  std::deque<std::string> dirs;
+  void Push(std::string dir) {
+    std::lock_guard<std::mutex> l(m);
+    dirs.push_back(std::move(dir));
+  }
+  bool PopBack(std::string& dir) {
+    std::lock_guard<std::mutex> l(m);
+    if (dirs.empty()) return false;
+    dir = std::move(dirs.back());
+    dirs.pop_back();
+    return true;
+  }
+  bool StealFront(std::string& dir) {
+    std::lock_guard<std::mutex> l(m);
+    if (dirs.empty()) return false;
+    dir = std::move(dirs.front());
+    dirs.pop_front();
+    return true;
+  }
+};
+
+bool IsDirectory(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+bool Statx(const std::string& path, int flags, struct statx& stx) {
+  return statx(AT_FDCWD, path.c_str(), flags, STATX_TYPE | STATX_MTIME | STATX_SIZE, &stx) == 0;
+}
+
+}
+
+DirectoryWalker::DirectoryWalker(size_t threadCount, std::function<bool(const std::string& path, const std::string& name)> prune,
+                                 std::function<bool(const std::string& name)> wantsMetadata)
+: threadCount(threadCount ? threadCount : std::max(1u, std::thread::hardware_concurrency()))
+, prune(prune)
+, wantsMetadata(wantsMetadata)
+{
+}
+
+std::vector<DirectoryWalker::Entry> DirectoryWalker::Walk(const std::string& root) {
+  std::vector<WorkQueue> queues(threadCount);
+  std::vector<std::vector<Entry>> results(threadCount);
+  std::atomic<size_t> pending(1);
+  // Idle workers sleep until a directory is queued or the walk is over. queued counts the
+  // directories in all queues; it goes up with idleMutex held, so no worker can miss that.
+  std::atomic<size_t> queued(1);
+  std::mutex idleMutex;
+  std::condition_variable work;
+  queues[0].Push(root);
+
+  auto listDirectory = [&](const std::string& dir, WorkQueue& queue, std::vector<Entry>& out) {
+    DIR* d = opendir(dir.c_str());
+    if (!d) return;
+    Entry self;
+    self.path = dir;
+    self.isDirectory = true;
+    while (struct dirent* de = readdir(d)) {
+      if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+      std::string name = de->d_name;
+      std::string path = dir + "/" + name;
+      bool isDir = false, isRegular = false, isLink = false, statted = false;
+      struct statx stx;
+      if (de->d_type == DT_DIR) {
+        isDir = true;
+      } else if (de->d_type == DT_REG) {
+        isRegular = true;
+      } else if (de->d_type == DT_LNK || de->d_type == DT_UNKNOWN) {
+        if (Statx(path, AT_SYMLINK_NOFOLLOW, stx)) {
+          isLink = S_ISLNK(stx.stx_mode);
+          if (isLink && !Statx(path, 0, stx)) stx.stx_mode = 0;
+          isDir = S_ISDIR(stx.stx_mode);
+          isRegular = S_ISREG(stx.stx_mode);
+          statted = true;
+        }
+      }
+      if (isDir) {
+        if (name == "include") self.hasIncludeDir = true;
+        else if (name == "src") self.hasSrcDir = true;
+        else if (name == "test") self.hasTestDir = true;
+      }
+      if (prune(path, name)) continue;
+      if (isRegular && !statted && wantsMetadata && wantsMetadata(name)) statted = Statx(path, 0, stx);
+      if (isDir && !isLink) {
+        pending++;
+        queue.Push(std::move(path));
+        std::lock_guard<std::mutex> l(idleMutex);
+        queued++;
+        work.notify_one();
+      } else if (isDir) {
+        // Symlinked directories are reported but, like recursive_directory_iterator, not followed.
+        Entry link;
+        link.path = path;
+        link.isDirectory = true;
+        link.hasIncludeDir = IsDirectory(path + "/include");
+        link.hasSrcDir = IsDirectory(path + "/src");
+        link.hasTestDir = IsDirectory(path + "/test");
+        out.push_back(std::move(link));
+      } else {
+        Entry file;
+        file.path = std::move(path);
+        file.isRegularFile = isRegular;
+        if (isRegular && statted) {
+          file.mtimeNs = stx.stx_mtime.tv_sec * 1000000000LL + stx.stx_mtime.tv_nsec;
+          file.size = stx.stx_size;
+        }
+        out.push_back(std::move(file));
+      }
+    }
+    closedir(d);
+    if (dir != root) out.push_back(std::move(self));
+  };
+
+  auto worker = [&](size_t id) {
+    std::string dir;
+    while (pending.load() != 0) {
+      bool found = queues[id].PopBack(dir);
+      for (size_t n = 1; !found && n < threadCount; n++) {
+        found = queues[(id + n) % threadCount].StealFront(dir);
+      }
+      if (!found) {
+        std::unique_lock<std::mutex> l(idleMutex);
+        work.wait(l, [&]{ return queued.load() != 0 || pending.load() == 0; });
+        continue;
+      }
+      queued--;
+      listDirectory(dir, queues[id], results[id]);
+      if (--pending == 0) {
+        std::lock_guard<std::mutex> l(idleMutex);
+        work.notify_all();
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t n = 1; n < threadCount; n++) {
+    threads.emplace_back(worker, n);
+  }
+  worker(0);
+  for (auto& t : threads) t.join();
+
+  std::vector<Entry> entries;
+  for (auto& r : results) {
+    std::move(r.begin(), r.end(), std::back_inserter(entries));
+  }
+  std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.path < b.path; });
+  return entries;
+}
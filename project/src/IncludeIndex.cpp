@@ -0,0 +1,104 @@
+#include "IncludeIndex.h"
+#include "Name.h"
+#include <algorithm>
+
+std::string Lowercase(const std::string& str) {
+  std::string lowercase;
+  std::transform(str.begin(), str.end(), std::back_inserter(lowercase), ::tolower);
+  return lowercase;
+}
+
+IncludeIndex::IncludeIndex() {
+  Clear();
+}
+
+void IncludeIndex::Clear() {
+  edges.clear();
+  nodes.assign(1, Node());
+  collisions.clear();
+}
+
+std::vector<std::string_view> IncludeIndex::ReversedComponents(const std::string& lowercasePath) {
+  std::vector<std::string_view> components;
+  size_t start = 0;
+  while (true) {
+    size_t slash = lowercasePath.find('/', start);
+    components.emplace_back(lowercasePath.data() + start, (slash == std::string::npos ? lowercasePath.size() : slash) - start);
+    if (slash == std::string::npos) break;
+    start = slash + 1;
+  }
+  std::reverse(components.begin(), components.end());
+  return components;
+}
+
+uint32_t IncludeIndex::Child(uint32_t parent, uint32_t name) const {
+  auto it = edges.find((uint64_t(parent) << 32) | name);
+  return it == edges.end() ? 0 : it->second;
+}
+
+void IncludeIndex::Add(File* file, const std::string& path) {
+  std::string lowercasePath = Lowercase(path);
+  std::vector<std::string_view> components = ReversedComponents(lowercasePath);
+  // Like an include spelling, a suffix never covers the whole path, only what follows a '/'.
+  uint32_t node = 0;
+  for (size_t depth = 0; depth + 1 < components.size(); depth++) {
+    uint64_t key = (uint64_t(node) << 32) | Name(components[depth]).id;
+    auto it = edges.find(key);
+    if (it == edges.end()) {
+      it = edges.emplace(key, nodes.size()).first;
+      nodes.emplace_back();
+    }
+    node = it->second;
+    Node& n = nodes[node];
+    if (n.count == 0) {
+      n.file = file;
+    } else {
+      std::vector<File*>& candidates = collisions[node];
+      if (candidates.empty()) candidates.push_back(n.file);
+      candidates.push_back(file);
+    }
+    n.count++;
+  }
+}
+
+void IncludeIndex::Remove(File* file, const std::string& path) {
+  std::string lowercasePath = Lowercase(path);
+  std::vector<std::string_view> components = ReversedComponents(lowercasePath);
+  uint32_t node = 0;
+  for (size_t depth = 0; depth + 1 < components.size(); depth++) {
+    Name name;
+    if (!Name::Find(components[depth], name)) return;
+    node = Child(node, name.id);
+    if (node == 0) return;
+    Node& n = nodes[node];
+    if (n.count == 0) continue;
+    if (--n.count == 0) {
+      n.file = nullptr;
+      continue;
+    }
+    auto it = collisions.find(node);
+    if (it == collisions.end()) continue;
+    std::vector<File*>& candidates = it->second;
+    candidates.erase(std::remove(candidates.begin(), candidates.end(), file), candidates.end());
+    if (n.count == 1) {
+      n.file = candidates.front();
+      collisions.erase(it);
+    }
+  }
+}
+
+IncludeIndex::Result IncludeIndex::Find(const std::string& spelling, File*& file) const {
+  std::string lowercaseSpelling = Lowercase(spelling);
+  uint32_t node = 0;
+  for (auto& component : ReversedComponents(lowercaseSpelling)) {
+    Name name;
+    if (!Name::Find(component, name)) return NotFound;
+    node = Child(node, name.id);
+    if (node == 0) return NotFound;
+  }
+  const Node& n = nodes[node];
+  if (n.count == 0) return NotFound;
+  if (n.count > 1) return Ambiguous;
+  file = n.file;
+  return Unique;
+}
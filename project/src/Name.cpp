@@ -0,0 +1,54 @@
+#include "Name.h"
+#include <mutex>
+
+StringTable& StringTable::Instance() {
+  static StringTable table;
+  return table;
+}
+
+StringTable::StringTable() {
+  Intern("");
+}
+
+bool StringTable::Find(std::string_view str, uint32_t& id) const {
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  auto it = ids.find(str);
+  if (it == ids.end()) return false;
+  id = it->second;
+  return true;
+}
+
+uint32_t StringTable::Intern(std::string_view str) {
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = ids.find(str);
+    if (it != ids.end()) return it->second;
+  }
+  std::unique_lock<std::shared_mutex> lock(mutex);
+  auto it = ids.find(str);
+  if (it != ids.end()) return it->second;
+  uint32_t id = ids.size();
+  uint32_t biased = id + firstSegmentSize;
+  int segment = 31 - __builtin_clz(biased) - firstSegmentBits;
+  std::string* storage = segments[segment].load(std::memory_order_relaxed);
+  if (!storage) {
+    storage = new std::string[firstSegmentSize << segment];
+    segments[segment].store(storage, std::memory_order_release);
+  }
+  std::string& entry = storage[biased - (firstSegmentSize << segment)];
+  entry = str;
+  bytes += sizeof(std::string) + (entry.capacity() > 15 ? entry.capacity() + 1 : 0);
+  ids.emplace(entry, id);
+  return id;
+}
+
+size_t StringTable::Count() const {
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  return ids.size();
+}
+
+size_t StringTable::Bytes() const {
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  // The strings themselves plus a node and a bucket in the reverse map.
+  return bytes + ids.size() * (sizeof(std::string_view) + sizeof(uint32_t) + 2 * sizeof(void*)) + ids.bucket_count() * sizeof(void*);
+}
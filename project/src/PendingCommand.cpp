@@ -1,8 +1,17 @@
 #include "PendingCommand.h"
+#include "BuildManifest.h"
 #include "File.h"
+#include "Hash.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/stat.h>
 
-PendingCommand::PendingCommand(const std::string& command) 
-: commandToRun(command)
+PendingCommand::PendingCommand(const std::string& command, BuildManifest* manifest, std::pmr::memory_resource* resource)
+: inputs(resource)
+, outputs(resource)
+, commandToRun(command)
+, commandHash(Fnv1a(command))
+, manifest(manifest)
 {
 }
 
@@ -28,69 +37,156 @@ void PendingCommand::Check() {
     // Assume always out of date
     state = PendingCommand::ToBeRun;
   }
-  if (state == PendingCommand::ToBeRun) return;
-  bool missingOutput = false;
-  std::time_t oldestOutput = outputs[0]->lastwrite();
+  if (state != PendingCommand::Unknown) return;
+  bool stale = false;
+  // In content-hash mode timestamps are only used for outputs that have no inputs digest yet.
+  bool contentHash = manifest && manifest->contentHash;
+  bool digestUnknown = false;
+  int64_t oldestOutput = outputs[0]->lastwrite();
   for (auto& out : outputs) {
-    if (out->lastwrite() == 0) missingOutput = true;
+    // A missing output, or one made by a different command line.
+    if (out->lastwrite() == 0) stale = true;
     else if (out->lastwrite() < oldestOutput) oldestOutput = out->lastwrite();
+    // Outputs from before the manifest existed have no record; they are trusted and adopted below.
+    const BuildManifest::Output* recorded = manifest ? manifest->Find(out->path.generic_string()) : nullptr;
+    if (recorded && recorded->commandHash != commandHash) stale = true;
+    if (contentHash && (!recorded || recorded->inputsDigest == 0)) digestUnknown = true;
   }
   for (auto& in : inputs) {
-    if (in->lastwrite() > oldestOutput) {
-      //printf("older source\n");
-      state = PendingCommand::ToBeRun;
-      for (auto& o : outputs) {
-        o->state = File::ToRebuild;
-        for (auto& d : o->dependencies) d->generator->Check();
-      }
-      return;
-    }
-    if (in->generator) {
-      in->generator->Check();
-      if (in->generator->state == PendingCommand::ToBeRun) {
-        //printf("input has generator that needs to be run\n");
-        state = PendingCommand::ToBeRun;
-        for (auto& o : outputs) {
-          o->state = File::ToRebuild;
-          for (auto& d : o->dependencies) d->generator->Check();
-        }
-        return;
-      }
+    if (stale) break;
+    if ((!contentHash || digestUnknown) && in->lastwrite() > oldestOutput) stale = true;
+    if (in->generator && in->generator->state == PendingCommand::ToBeRun) stale = true;
+  }
+  uint64_t digest = 0;
+  if (!stale && contentHash && !digestUnknown) {
+    digest = InputsDigest();
+    for (auto& out : outputs) {
+      if (manifest->Find(out->path.generic_string())->inputsDigest != digest) stale = true;
     }
   }
-  if (missingOutput) {
-    //printf("missing output\n");
+  if (stale) {
     state = PendingCommand::ToBeRun;
-    for (auto& o : outputs) {
-      o->state = File::ToRebuild;
-      for (auto& d : o->dependencies) d->generator->Check();
-    }
+    for (auto& o : outputs) o->state = File::ToRebuild;
     return;
   }
   for (auto& o : outputs) {
     o->state = File::Done;
+    if (!manifest) continue;
+    std::string path = o->path.generic_string();
+    const BuildManifest::Output* recorded = manifest->Find(path);
+    if (!recorded) manifest->Get(path).commandHash = commandHash;
+    if (contentHash && (!recorded || recorded->inputsDigest == 0)) {
+      if (!digest) digest = InputsDigest();
+      manifest->Get(path).inputsDigest = digest;
+    }
   }
   state = PendingCommand::Done;
 }
 
+void PendingCommand::HashOutputs(bool success) {
+  outputHashes.clear();
+  for (auto& o : outputs) {
+    o->previousMtimeNs = o->statted ? o->mtimeNs : 0;
+    o->Stat();
+    uint64_t hash = (success && manifest) ? manifest->ContentHash(o->path.generic_string(), o->mtimeNs, o->size) : 0;
+    outputHashes.push_back(hash);
+  }
+}
+
 void PendingCommand::SetResult(bool success) {
+  if (outputHashes.size() != outputs.size()) HashOutputs(success);
   state = PendingCommand::Done;
-  for (auto& o : outputs) {
+  rebuilt = true;
+  outputsChanged = !success || !manifest;
+  uint64_t digest = (success && manifest && manifest->contentHash) ? inputsDigest : 0;
+  for (size_t index = 0; index < outputs.size(); index++) {
+    File* o = outputs[index];
     o->state = (success ? File::Done : File::Error);
+    if (!manifest) continue;
+    // A failed command may have left a partial output behind. Recording no command at all makes
+    // sure it is rebuilt even though it is newer than its inputs.
+    std::string path = o->path.generic_string();
+    BuildManifest::Output& recorded = manifest->Get(path);
+    recorded.commandHash = success ? commandHash : 0;
+    recorded.inputsDigest = digest;
+    recorded.componentKey = 0;
+    uint64_t hash = outputHashes[index];
+    if (hash == 0 || hash != recorded.outputHash) outputsChanged = true;
+    recorded.outputHash = hash;
   }
 }
 
-bool PendingCommand::CanRun() {
-  if (state != PendingCommand::ToBeRun) return false;
+bool PendingCommand::CanSkip() {
+  if (!manifest || outputs.empty()) return false;
+  bool digestKnown = manifest->contentHash;
+  int64_t oldestOutput = outputs[0]->lastwrite();
+  for (auto& out : outputs) {
+    if (out->lastwrite() == 0) return false;
+    if (out->lastwrite() < oldestOutput) oldestOutput = out->lastwrite();
+    const BuildManifest::Output* recorded = manifest->Find(out->path.generic_string());
+    if (!recorded || recorded->commandHash != commandHash) return false;
+    if (recorded->inputsDigest == 0) digestKnown = false;
+  }
+  if (digestKnown) {
+    uint64_t digest = InputsDigest();
+    for (auto& out : outputs) {
+      if (manifest->Find(out->path.generic_string())->inputsDigest != digest) return false;
+    }
+    return true;
+  }
+  // Inputs rebuilt in this build are newer than our outputs whether or not they changed, so for
+  // those only their generator knows. Coming out the same as its last build is not enough, though:
+  // that build may have been interrupted before we consumed it, so the version it replaced must
+  // also be older than our outputs.
   for (auto& in : inputs) {
-    if (in->state != File::Unknown && in->state != File::Source && in->state != File::Done) {
-//      printf("Cannot build %s because %s is in %d\n", outputs[0]->path.filename().c_str(), in->path.filename().c_str(), in->state);
+    if (in->generator && in->generator->rebuilt) {
+      if (in->generator->outputsChanged || in->previousMtimeNs == 0 || in->previousMtimeNs > oldestOutput) return false;
+    } else if (in->lastwrite() > oldestOutput) {
       return false;
     }
   }
   return true;
 }
 
+void PendingCommand::Skip() {
+  state = PendingCommand::Done;
+  rebuilt = true;
+  outputsChanged = false;
+  for (auto& o : outputs) {
+    o->state = File::Done;
+    // Keep the outputs newer than the inputs that were just rewritten, or the next build would
+    // find them out of date after all.
+    utimensat(AT_FDCWD, o->path.c_str(), nullptr, 0);
+    // Statted right away rather than lazily: consumers check their inputs from several threads.
+    o->previousMtimeNs = o->statted ? o->mtimeNs : 0;
+    o->Stat();
+  }
+}
+
+uint64_t PendingCommand::InputsDigest() const {
+  // Inputs come out of unordered sets, so their hashes are sorted to make the digest independent of order.
+  std::vector<uint64_t> hashes;
+  hashes.reserve(inputs.size());
+  for (auto& in : inputs) {
+    std::string path = in->path.generic_string();
+    uint64_t contents = manifest->ContentHash(path, in->lastwrite(), in->size);
+    hashes.push_back(Xxh64(&contents, sizeof(contents), Fnv1a(path)));
+  }
+  std::sort(hashes.begin(), hashes.end());
+  uint64_t digest = Xxh64(hashes.data(), hashes.size() * sizeof(uint64_t));
+  return digest ? digest : 1;
+}
+
+size_t PendingCommand::CountBlockedInputs() const {
+  size_t count = 0;
+  for (auto& in : inputs) {
+    if (in->state != File::Unknown && in->state != File::Source && in->state != File::Done) {
+      count++;
+    }
+  }
+  return count;
+}
+
 std::ostream& operator<<(std::ostream& os, const PendingCommand& pc) {
   os << pc.commandToRun << " state=";
   switch(pc.state) {
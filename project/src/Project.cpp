@@ -3,14 +3,34 @@
 #include <boost/filesystem.hpp>
 #include "Component.h"
 #include "Configuration.h"
+#include "DirectiveScanner.h"
+#include "DirectoryWalker.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
 #include <fcntl.h>
+#include <functional>
 #include "File.h"
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
 #include <unistd.h>
 #include "known.h"
 
-Project::Project() {
+// EVOKE_STATS=1 reports how the scan cache, string interning and the graph arena did on each full reload.
+static bool PrintStats() {
+  static bool enabled = [] {
+    const char* env = getenv("EVOKE_STATS");
+    return env && env[0] == '1';
+  }();
+  return enabled;
+}
+
+Project::Project(size_t scanThreads)
+: scanThreads(scanThreads)
+{
   projectRoot = boost::filesystem::current_path();
+  manifest.Load(".evoke/manifest");
   Reload();
 }
 
@@ -18,16 +38,23 @@ Project::~Project() {
 }
 
 void Project::Reload() {
+  ClearCommands();
   unknownHeaders.clear();
-  components.clear();
-  files.clear();
   ambiguous.clear();
+  // Everything that points into the graph goes before the graph itself is dropped in one go.
+  includeIndex.Clear();
+  resolutions.clear();
+  includersByName.clear();
+  std::pmr::unordered_map<Name, File>(&graphArena).swap(files);
+  components.clear();
+  graphArena.Release();
+  scanCache.Load(".evoke/scan.db");
   LoadFileList();
+  scanCache.Save(".evoke/scan.db");
+  if (PrintStats()) printf("Scan cache: %zu hits, %zu misses\n", scanCache.hits, scanCache.misses);
 
-  std::unordered_map<std::string, std::string> includeLookup;
-  std::unordered_map<std::string, std::set<std::string>> collisions;
-  CreateIncludeLookupTable(includeLookup, collisions);
-  MapIncludesToDependencies(includeLookup, ambiguous);
+  CreateIncludeLookupTable();
+  MapIncludesToDependencies();
   if (!ambiguous.empty()) {
     fprintf(stderr, "Ambiguous includes found!\n");
     for (auto &i : ambiguous) {
@@ -41,14 +68,289 @@ void Project::Reload() {
   PropagateExternalIncludes();
   ExtractPublicDependencies();
   ExtractIncludePaths();
+  if (PrintStats()) {
+    ReportNameUsage();
+    printf("Arena: %.1f MB in use for %zu files, %.1f MB reserved\n", graphArena.BytesAllocated() / 1048576.0, files.size(),
+           graphArena.BytesReserved() / 1048576.0);
+  }
+}
+
+static size_t StringBytes(const std::string& str) {
+  // Heap storage only exists beyond the small string buffer.
+  return sizeof(std::string) + (str.size() > 15 ? str.size() + 1 : 0);
+}
+
+void Project::ReportNameUsage() {
+  if (files.empty()) return;
+  size_t names = 0, stringBytes = 0;
+  for (auto& p : files) {
+    stringBytes += StringBytes(p.first.str());
+    for (auto& i : p.second.rawIncludes) stringBytes += StringBytes(i.first.str());
+    for (auto& i : p.second.includePaths) stringBytes += StringBytes(i.str());
+    names += 1 + p.second.rawIncludes.size() + p.second.includePaths.size();
+  }
+  for (auto& c : components) {
+    for (auto& i : c.second.pubIncl) stringBytes += StringBytes(i.str());
+    for (auto& i : c.second.privIncl) stringBytes += StringBytes(i.str());
+    names += c.second.pubIncl.size() + c.second.privIncl.size();
+  }
+  StringTable& table = StringTable::Instance();
+  size_t nameBytes = names * sizeof(Name) + table.Bytes();
+  printf("Interned %zu strings (%.1f KB); paths and include names take %.0f bytes per file, %.0f as separate strings\n", table.Count(),
+         table.Bytes() / 1024.0, double(nameBytes) / files.size(), double(stringBytes) / files.size());
+}
+
+static Component* GetComponentFor(std::unordered_map<std::string, Component> &components, boost::filesystem::path path) {
+  Component* rv = nullptr;
+  size_t matchLength = 0;
+  for (auto& p : components) {
+    if (p.first.size() > matchLength &&
+        p.first.size() < path.string().size() &&
+        path.string().compare(0, p.first.size(), p.first) == 0) {
+      rv = &p.second;
+      matchLength = p.first.size();
+    }
+  }
+  return rv;
+}
+
+static std::string LowercaseFileName(const std::string& path) {
+  return Lowercase(path.substr(path.find_last_of('/') + 1));
+}
+
+void Project::Reload(const std::set<std::string>& added, const std::set<std::string>& removed, const std::set<std::string>& modified) {
+  // Storage of erased files and rewritten edges is only reclaimed by a full reload; do one once that
+  // has become the bulk of the arena.
+  if (graphArena.BytesDiscarded() > graphArena.BytesAllocated() / 2) {
+    Reload();
+    return;
+  }
+  ClearCommands();
+  // Files whose includes need resolving again, and components whose classification may change with them.
+  std::unordered_set<File*> affected;
+  std::unordered_set<Component*> involved;
+  auto markAffected = [&](File* f) {
+    if (!affected.insert(f).second) return;
+    involved.insert(&f->component);
+    for (File* dep : f->dependencies) involved.insert(&dep->component);
+  };
+  // Any include that could resolve to a new or vanished path ends in the same file name.
+  auto markIncludersOf = [&](const std::string& path) {
+    auto it = includersByName.find(LowercaseFileName(path));
+    if (it == includersByName.end()) return;
+    std::vector<File*> includers(it->second.begin(), it->second.end());
+    for (File* f : includers) markAffected(f);
+  };
+
+  for (auto& path : removed) {
+    Name name;
+    if (!Name::Find(path, name) || !files.count(name)) continue;
+    auto it = files.find(name);
+    File& f = it->second;
+    markIncludersOf(path);
+    for (File* includer : f.includers) {
+      markAffected(includer);
+      includer->dependencies.erase(&f);
+    }
+    f.includers.clear();
+    involved.insert(&f.component);
+    for (File* dep : f.dependencies) involved.insert(&dep->component);
+    UnresolveIncludes(f);
+    includeIndex.Remove(&f, path);
+    resolutions.clear();
+    affected.erase(&f);
+    f.component.files.erase(&f);
+    scanCache.Forget(path);
+    files.erase(it);
+  }
+
+  for (auto& path : added) {
+    if (FindFile(path)) continue;
+    Component* component = GetComponentFor(components, "./" + path);
+    if (!component) {
+      fprintf(stderr, "Found file ./%s outside of any component\n", path.c_str());
+      continue;
+    }
+    File& f = files.emplace(Name(path), File(path, *component, &graphArena)).first->second;
+    component->files.insert(&f);
+    bool cached = ReadCode(f, "./" + path);
+    scanCache.Store(f, path, f.size, f.mtimeNs, cached);
+    includeIndex.Add(&f, path);
+    resolutions.clear();
+    markIncludersOf(path);
+    markAffected(&f);
+  }
+
+  for (auto& path : modified) {
+    File* fp = FindFile(path);
+    if (!fp) continue;
+    File& f = *fp;
+    File rescanned(f.path, f.component);
+    ReadCode(rescanned, "./" + path);
+    f.SetMetadata(rescanned.mtimeNs, rescanned.size);
+    if (rescanned.rawIncludes != f.rawIncludes ||
+        rescanned.imports != f.imports ||
+        rescanned.moduleName != f.moduleName ||
+        rescanned.moduleExported != f.moduleExported) {
+      markAffected(&f);
+      UnresolveIncludes(f);
+      f.rawIncludes = std::move(rescanned.rawIncludes);
+      f.imports = std::move(rescanned.imports);
+      f.moduleName = std::move(rescanned.moduleName);
+      f.moduleExported = rescanned.moduleExported;
+    }
+    scanCache.Store(f, path, f.size, f.mtimeNs, false);
+  }
+
+  if (involved.empty()) return;
+
+  // Everything derived from include edges is rebuilt for the involved components. Their files'
+  // includers elsewhere are resolved again too, since those edges are what set the flags, but
+  // they leave their own component's dependencies alone.
+  std::unordered_set<File*> toResolve(affected);
+  for (Component* comp : involved) {
+    comp->pubDeps.clear();
+    comp->privDeps.clear();
+    comp->pubIncl.clear();
+    comp->privIncl.clear();
+    for (File* f : comp->files) {
+      f->hasInclude = false;
+      f->hasExternalInclude = false;
+      f->includePaths.clear();
+      toResolve.insert(f);
+      toResolve.insert(f->includers.begin(), f->includers.end());
+    }
+  }
+  for (File* f : toResolve) {
+    UnresolveIncludes(*f);
+    ResolveIncludes(*f, involved.count(&f->component) > 0);
+  }
+
+  // Components that merely gained an includer only need their classification redone.
+  std::unordered_set<Component*> reclassify(involved);
+  for (File* f : affected) {
+    for (File* dep : f->dependencies) reclassify.insert(&dep->component);
+  }
+  for (Component* comp : reclassify) {
+    PropagateExternalIncludes(*comp);
+    ExtractPublicDependencies(*comp);
+    ExtractIncludePaths(*comp);
+  }
+  printf("Incremental reload: %zu added, %zu removed, %zu modified; resolved %zu files, reclassified %zu components\n",
+         added.size(), removed.size(), modified.size(), toResolve.size(), reclassify.size());
+}
+
+void Project::ClearCommands() {
+  for (auto& c : components) {
+    c.second.commands.clear();
+  }
+  buildPipeline.clear();
+  std::pmr::unordered_map<Name, File>(&commandArena).swap(generatedFiles);
+  commandArena.Release();
+  for (auto& p : files) {
+    File& f = p.second;
+    f.listeners.clear();
+    f.generator = nullptr;
+    f.state = File::Source;
+  }
+}
+
+PendingCommand* Project::CreateCommand(const std::string& command) {
+  return commandArena.Create<PendingCommand>(command, &manifest, &commandArena);
+}
+
+void Project::CheckCommands() {
+    // Commands are visited a wave at a time: a command joins the next wave once every command
+    // generating one of its inputs has been checked, so nothing recurses and nothing is checked
+    // twice. Within a wave the commands are independent of each other.
+    // Only files still in the graph keep their manifest records.
+    std::unordered_set<std::string> live;
+    for (auto& f : files) live.insert(f.second.path.generic_string());
+    for (auto& f : generatedFiles) live.insert(f.second.path.generic_string());
+    manifest.Retain(live);
+
+    std::vector<PendingCommand*> wave;
+    std::unordered_map<PendingCommand*, size_t> waitingFor;
+    std::unordered_set<File*> touched;
+    size_t total = 0;
+    for (auto& c : components) {
+        for (auto& pc : c.second.commands) {
+            total++;
+            size_t generated = 0;
+            for (auto& in : pc->inputs) {
+                touched.insert(in);
+                if (in->generator) generated++;
+            }
+            for (auto& out : pc->outputs) touched.insert(out);
+            if (generated) waitingFor[pc] = generated;
+            else wave.push_back(pc);
+        }
+    }
+
+    size_t threadCount = scanThreads ? scanThreads : std::max(1u, std::thread::hardware_concurrency());
+    // Splits work over the threads when there is enough of it to be worth starting them.
+    auto parallel = [threadCount](size_t count, const std::function<void(size_t)>& fn) {
+        const size_t chunk = 64;
+        size_t threadsUsed = std::min(threadCount, (count + chunk - 1) / chunk);
+        std::atomic<size_t> next(0);
+        auto worker = [&] {
+            for (size_t base = next.fetch_add(chunk); base < count; base = next.fetch_add(chunk)) {
+                for (size_t index = base; index < std::min(base + chunk, count); index++) fn(index);
+            }
+        };
+        std::vector<std::thread> threads;
+        for (size_t n = 1; n < threadsUsed; n++) threads.emplace_back(worker);
+        worker();
+        for (auto& t : threads) t.join();
+    };
+
+    // Sources already carry their metadata from the directory walk; everything else (mostly
+    // outputs) is statted here in one parallel batch, so the checks only read it.
+    std::vector<File*> statList;
+    for (auto& f : touched) {
+        if (!f->statted) statList.push_back(f);
+    }
+    parallel(statList.size(), [&statList](size_t index) { statList[index]->Stat(); });
+
+    size_t checked = 0;
+    while (!wave.empty()) {
+        parallel(wave.size(), [&wave](size_t index) { wave[index]->Check(); });
+        checked += wave.size();
+        std::vector<PendingCommand*> next;
+        for (auto& pc : wave) {
+            for (auto& out : pc->outputs) {
+                for (auto& listener : out->listeners) {
+                    if (--waitingFor[listener] == 0) next.push_back(listener);
+                }
+            }
+        }
+        wave.swap(next);
+    }
+    if (checked != total) {
+        // Whatever is left waits on itself; running it is the only way to find out more.
+        fprintf(stderr, "%zu commands depend on each other's outputs in a cycle\n", total - checked);
+        for (auto& w : waitingFor) {
+            if (!w.second || w.first->state != PendingCommand::Unknown) continue;
+            w.first->state = PendingCommand::ToBeRun;
+            for (auto& o : w.first->outputs) o->state = File::ToRebuild;
+        }
+    }
+}
+
+File* Project::FindFile(const std::string& path) {
+  Name name;
+  if (!Name::Find(path, name)) return nullptr;
+  auto it = files.find(name);
+  return it == files.end() ? nullptr : &it->second;
 }
 
 File* Project::CreateFile(Component& c, boost::filesystem::path p) {
   std::string subpath = p.string();
   if (subpath[0] == '.' && subpath[1] == '/')
     subpath = subpath.substr(2);
-  File f(p, c);
-  auto f2 = files.emplace(p.string(), std::move(f));
+  if (File* source = FindFile(p.string())) return source;
+  File f(p, c, &commandArena);
+  auto f2 = generatedFiles.emplace(Name(p.string()), std::move(f));
   return &f2.first->second;
 }
 
@@ -63,15 +365,26 @@ std::ostream& operator<<(std::ostream& os, const Project& p) {
   return os;
 }
 
-void Project::ReadCode(std::unordered_map<std::string, File>& files, const boost::filesystem::path &path, Component& comp) {
-    File& f = files.emplace(path.generic_string().substr(2), File(path.generic_string().substr(2), comp)).first->second;
-    comp.files.insert(&f);
+bool Project::ReadCode(File& f, const std::string& path) {
+    if (f.lastwrite() != 0 && scanCache.Apply(f, f.path.generic_string(), f.size, f.mtimeNs)) return true;
+    // The file may have changed since it was statted; what gets parsed is what gets recorded.
     int fd = open(path.c_str(), O_RDONLY);
-    size_t fileSize = boost::filesystem::file_size(path);
-    void* p = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
-    ReadCodeFrom(f, static_cast<const char*>(p), fileSize);
-    munmap(p, fileSize);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) close(fd);
+        f.SetMetadata(0, 0);
+        return false;
+    }
+    f.SetMetadata(st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec, st.st_size);
+    if (f.size) {
+        void* p = mmap(NULL, f.size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            ReadCodeFrom(f, static_cast<const char*>(p), f.size);
+            munmap(p, f.size);
+        }
+    }
     close(fd);
+    return false;
 }
 
 bool Project::IsItemBlacklisted(const boost::filesystem::path &path) {
@@ -97,52 +410,96 @@ bool Project::IsCompilationUnit(const std::string& ext) {
     return exts.count(ext) > 0;
 }
 
-static Component* GetComponentFor(std::unordered_map<std::string, Component> &components, boost::filesystem::path path) {
-  Component* rv = nullptr;
-  size_t matchLength = 0;
-  for (auto& p : components) {
-    if (p.first.size() > matchLength &&
-        p.first.size() < path.string().size() &&
-        path.string().compare(0, p.first.size(), p.first) == 0) {
-      rv = &p.second;
-      matchLength = p.first.size();
-    }
-  }
-  return rv;
-}
-
 void Project::LoadFileList() {
-  std::string root = ".";
-  for (boost::filesystem::recursive_directory_iterator it("."), end;
-       it != end; ++it) {
-      boost::filesystem::path parent = it->path().parent_path();
+  auto start = std::chrono::steady_clock::now();
+  DirectoryWalker walker(scanThreads, [this](const std::string& path, const std::string& fileName) {
       // skip hidden files and dirs
-      std::string fileName = it->path().filename().generic_string();
-      if ((fileName.size() >= 2 && fileName[0] == '.') ||
-          IsItemBlacklisted(it->path())) {
-          it.disable_recursion_pending();
-          continue;
-      }
-      
-      if (boost::filesystem::is_directory(it->status())) {
-          if (boost::filesystem::is_directory(it->path() / "include") ||
-              boost::filesystem::is_directory(it->path() / "src"))
-          {
-              components.emplace(it->path().c_str(), it->path());
-              if (boost::filesystem::is_directory(it->path() / "test")) {
-                  components.emplace((it->path() / "test").c_str(), it->path() / "test").first->second.type = "unittest";
-              }
+      return (fileName.size() >= 2 && fileName[0] == '.') ||
+             IsItemBlacklisted(path);
+  }, [this](const std::string& fileName) {
+      size_t dot = fileName.rfind('.');
+      return dot != std::string::npos && IsCode(fileName.substr(dot));
+  });
+  std::vector<DirectoryWalker::Entry> entries = walker.Walk(".");
+  size_t directoryCount = 0;
+  for (auto& e : entries) {
+      if (!e.isDirectory) continue;
+      directoryCount++;
+      if (e.hasIncludeDir || e.hasSrcDir) {
+          components.emplace(e.path, e.path);
+          if (e.hasTestDir) {
+              components.emplace(e.path + "/test", e.path + "/test").first->second.type = "unittest";
           }
-      } else if (boost::filesystem::is_regular_file(it->status()) &&
-          IsCode(it->path().extension().generic_string().c_str())) {
-          Component* component = GetComponentFor(components, it->path());
+      }
+  }
+  printf("Directory walk: %zu directories, %zu files in %.1f ms using %zu threads\n", directoryCount, entries.size() - directoryCount,
+         std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(), walker.threadCount);
+
+  std::vector<std::pair<const DirectoryWalker::Entry*, Component*>> codeFiles;
+  for (auto& e : entries) {
+      boost::filesystem::path path(e.path);
+      if (e.isRegularFile &&
+          IsCode(path.extension().generic_string().c_str())) {
+          Component* component = GetComponentFor(components, path);
           if (component) {
-              ReadCode(files, it->path(), *component);
+              codeFiles.emplace_back(&e, component);
           } else {
-              fprintf(stderr, "Found file %s outside of any component\n", it->path().c_str());
+              fprintf(stderr, "Found file %s outside of any component\n", path.c_str());
           }
       }
   }
+
+  // Parse on all workers into per-thread staging records, then merge them in walk order so
+  // the resulting project does not depend on which thread parsed what.
+  start = std::chrono::steady_clock::now();
+  struct Staged {
+      size_t index;
+      bool cached;
+      File file;
+  };
+  size_t threadCount = std::min(walker.threadCount, std::max<size_t>(1, codeFiles.size() / 16));
+  std::vector<std::vector<Staged>> staging(threadCount);
+  std::atomic<size_t> next(0);
+  auto worker = [&](size_t id) {
+      const size_t chunk = 16;
+      for (size_t base = next.fetch_add(chunk); base < codeFiles.size(); base = next.fetch_add(chunk)) {
+          for (size_t index = base; index < std::min(base + chunk, codeFiles.size()); index++) {
+              const DirectoryWalker::Entry& e = *codeFiles[index].first;
+              // The arena is not thread safe, so staged files use the default resource until the merge.
+              staging[id].push_back(Staged{index, false, File(e.path.substr(2), *codeFiles[index].second)});
+              Staged& s = staging[id].back();
+              s.file.SetMetadata(e.mtimeNs, e.size);
+              s.cached = ReadCode(s.file, e.path);
+          }
+      }
+  };
+  std::vector<std::thread> threads;
+  for (size_t n = 1; n < threadCount; n++) {
+      threads.emplace_back(worker, n);
+  }
+  worker(0);
+  for (auto& t : threads) t.join();
+
+  std::vector<Staged*> ordered(codeFiles.size());
+  for (auto& s : staging) {
+      for (auto& st : s) ordered[st.index] = &st;
+  }
+  uint64_t bytes = 0;
+  for (auto& s : ordered) {
+      std::string subpath = s->file.path.generic_string();
+      File& f = files.emplace(Name(subpath), File(s->file.path, s->file.component, &graphArena)).first->second;
+      f.rawIncludes = std::move(s->file.rawIncludes);
+      f.imports = std::move(s->file.imports);
+      f.moduleName = std::move(s->file.moduleName);
+      f.moduleExported = s->file.moduleExported;
+      f.SetMetadata(s->file.mtimeNs, s->file.size);
+      f.component.files.insert(&f);
+      scanCache.Store(f, subpath, f.size, f.mtimeNs, s->cached);
+      if (!s->cached) bytes += f.size;
+  }
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  printf("Parsed %zu files (%.1f MB read) in %.1f ms using %zu threads, %.0f MB/s with the %s scanner\n", scanCache.misses, bytes / 1048576.0,
+         ms, threadCount, ms > 0 ? bytes / 1048576.0 / (ms / 1000) : 0.0, GetDirectiveScannerName());
 }
 
 static std::map<std::string, Component*> PredefComponentList() {
@@ -159,66 +516,117 @@ static Component* GetPredefComponent(const boost::filesystem::path& path) {
   return nullptr;
 }
 
-void Project::MapIncludesToDependencies(std::unordered_map<std::string, std::string> &includeLookup,
-                                        std::unordered_map<std::string, std::vector<std::string>> &ambiguous) {
+void Project::MapIncludesToDependencies() {
     for (auto &fp : files) {
-        for (auto &p : fp.second.rawIncludes) {
-            // If this is a non-pointy bracket include, see if there's a local match first. 
-            // If so, it always takes precedence, never needs an include path added, and never is ambiguous (at least, for the compiler).
-            std::string fullFilePath = (boost::filesystem::path(fp.first).parent_path() / p.first).generic_string();
-            if (!p.second && files.count(fullFilePath)) {
-                // This file exists as a local include.
-                File* dep = &files.find(fullFilePath)->second;
-                dep->hasInclude = true;
-                fp.second.dependencies.insert(dep);
+        ResolveIncludes(fp.second, true);
+    }
+}
+
+const Project::Resolution& Project::Resolve(const std::string& dir, const std::string& spelling, bool pointyBrackets) {
+    // Only quoted includes depend on the including directory.
+    std::string key = pointyBrackets ? "<" + spelling : dir + '"' + spelling;
+    auto it = resolutions.find(key);
+    if (it != resolutions.end()) return it->second;
+    Resolution r{Resolution::NotFound, nullptr, nullptr};
+    // If this is a non-pointy bracket include, see if there's a local match first. 
+    // If so, it always takes precedence, never needs an include path added, and never is ambiguous (at least, for the compiler).
+    File* local = pointyBrackets ? nullptr : FindFile((boost::filesystem::path(dir) / spelling).generic_string());
+    if (local) {
+        r.kind = Resolution::Local;
+        r.file = local;
+    } else {
+        switch (includeIndex.Find(spelling, r.file)) {
+        case IncludeIndex::Ambiguous: r.kind = Resolution::Ambiguous; break;
+        case IncludeIndex::Unique: r.kind = Resolution::Unique; break;
+        case IncludeIndex::NotFound: break;
+        }
+        r.predef = GetPredefComponent(Lowercase(spelling));
+    }
+    return resolutions.emplace(std::move(key), r).first->second;
+}
+
+void Project::ResolveIncludes(File& f, bool updateComponent) {
+    std::string filePath = f.path.generic_string();
+    std::string dir = f.path.parent_path().generic_string();
+    for (auto &i : f.rawIncludes) {
+        const std::string& spelling = i.first.str();
+        includersByName[LowercaseFileName(spelling)].insert(&f);
+        const Resolution& r = Resolve(dir, spelling, i.second);
+        if (r.kind == Resolution::Local) {
+            // This file exists as a local include.
+            File* dep = r.file;
+            dep->hasInclude = true;
+            f.dependencies.insert(dep);
+            dep->includers.insert(&f);
+        } else if (r.kind == Resolution::Ambiguous) {
+            // We end up in more than one place. That's an ambiguous include then.
+            ambiguous[Lowercase(spelling)].push_back(filePath);
+        } else if (r.predef) {
+            if (updateComponent) f.component.privDeps.insert(r.predef);
+        } else if (r.kind == Resolution::Unique) {
+            File *dep = r.file;
+            f.dependencies.insert(dep);
+            dep->includers.insert(&f);
+
+            std::string fullPath = dep->path.generic_string();
+            std::string inclpath = fullPath.substr(0, fullPath.size() - spelling.size() - 1);
+            if (inclpath.size() == dep->component.root.generic_string().size()) {
+                inclpath = ".";
+            } else if (inclpath.size() > dep->component.root.generic_string().size() + 1) {
+                inclpath = inclpath.substr(dep->component.root.generic_string().size() + 1);
             } else {
-                // We need to use an include path to find this. So let's see where we end up.
-                std::string lowercaseInclude;
-                std::transform(p.first.begin(), p.first.end(), std::back_inserter(lowercaseInclude), ::tolower);
-                const std::string &fullPath = includeLookup[lowercaseInclude];
-                if (fullPath == "INVALID") {
-                    // We end up in more than one place. That's an ambiguous include then.
-                    ambiguous[lowercaseInclude].push_back(fp.first);
-                } else if (GetPredefComponent(lowercaseInclude)) {
-                    Component* comp = GetPredefComponent(lowercaseInclude);
-                    fp.second.component.privDeps.insert(comp);
-                } else if (files.count(fullPath)) {
-                    File *dep = &files.find(fullPath)->second;
-                    fp.second.dependencies.insert(dep);
-
-                    std::string inclpath = fullPath.substr(0, fullPath.size() - p.first.size() - 1);
-                    if (inclpath.size() == dep->component.root.generic_string().size()) {
-                        inclpath = ".";
-                    } else if (inclpath.size() > dep->component.root.generic_string().size() + 1) {
-                        inclpath = inclpath.substr(dep->component.root.generic_string().size() + 1);
-                    } else {
-                        inclpath = "";
-                    }
-                    if (!inclpath.empty()) {
-                        dep->includePaths.insert(inclpath);
-                    }
+                inclpath = "";
+            }
+            if (!inclpath.empty()) {
+                dep->includePaths.insert(Name(inclpath));
+            }
 
-                    if (&fp.second.component != &dep->component) {
-                        fp.second.component.privDeps.insert(&dep->component);
-                        dep->hasExternalInclude = true;
-                    }
-                    dep->hasInclude = true;
-                } else if (!IsKnownHeader(p.first)) {
-                    unknownHeaders.insert(p.first);
-                }
+            if (&f.component != &dep->component) {
+                if (updateComponent) f.component.privDeps.insert(&dep->component);
+                dep->hasExternalInclude = true;
             }
+            dep->hasInclude = true;
+        } else if (!IsKnownHeader(spelling)) {
+            unknownHeaders.insert(spelling);
+        }
+    }
+}
+
+void Project::UnresolveIncludes(File& f) {
+    for (File* dep : f.dependencies) {
+        dep->includers.erase(&f);
+    }
+    f.dependencies.clear();
+    std::string filePath = f.path.generic_string();
+    for (auto &i : f.rawIncludes) {
+        const std::string& spelling = i.first.str();
+        auto it = includersByName.find(LowercaseFileName(spelling));
+        if (it != includersByName.end()) {
+            it->second.erase(&f);
+            if (it->second.empty()) includersByName.erase(it);
+        }
+        auto amb = ambiguous.find(Lowercase(spelling));
+        if (amb != ambiguous.end()) {
+            amb->second.erase(std::remove(amb->second.begin(), amb->second.end(), filePath), amb->second.end());
+            if (amb->second.empty()) ambiguous.erase(amb);
         }
     }
 }
 
 void Project::PropagateExternalIncludes() {
+    for (auto &c : components) {
+        PropagateExternalIncludes(c.second);
+    }
+}
+
+void Project::PropagateExternalIncludes(Component& comp) {
     bool foundChange;
     do {
         foundChange = false;
-        for (auto &fp : files) {
-            if (fp.second.hasExternalInclude) {
-                for (auto &dep : fp.second.dependencies) {
-                    if (!dep->hasExternalInclude && &dep->component == &fp.second.component) {
+        for (auto &f : comp.files) {
+            if (f->hasExternalInclude) {
+                for (auto &dep : f->dependencies) {
+                    if (!dep->hasExternalInclude && &dep->component == &comp) {
                         dep->hasExternalInclude = true;
                         foundChange = true;
                     }
@@ -228,59 +636,51 @@ void Project::PropagateExternalIncludes() {
     } while (foundChange);
 }
 
-void Project::CreateIncludeLookupTable(std::unordered_map<std::string, std::string> &includeLookup,
-                                       std::unordered_map<std::string, std::set<std::string>> &collisions) {
+void Project::CreateIncludeLookupTable() {
+    includeIndex.Clear();
+    resolutions.clear();
+    includersByName.clear();
     for (auto &p : files) {
-        std::string lowercasePath;
-        std::transform(p.first.begin(), p.first.end(), std::back_inserter(lowercasePath), ::tolower);
-        const char *pa = lowercasePath.c_str();
-        while ((pa = strstr(pa + 1, "/"))) {
-            std::string &ref = includeLookup[pa + 1];
-            if (ref.size() == 0) {
-                ref = p.first;
-            } else {
-                collisions[pa + 1].insert(p.first);
-                if (ref != "INVALID") {
-                    collisions[pa + 1].insert(ref);
-                }
-                ref = "INVALID";
-            }
-        }
+        includeIndex.Add(&p.second, p.first.str());
     }
 }
 
 void Project::ExtractPublicDependencies() {
     for (auto &c : components) {
-        bool hasExtIncludes = false;
-        Component &comp = c.second;
-        for (auto &fp : comp.files) {
-            if (fp->hasExternalInclude) {
-                hasExtIncludes = true;
-                for (auto &dep : fp->dependencies) {
-                    comp.privDeps.erase(&dep->component);
-                    comp.pubDeps.insert(&dep->component);
-                }
+        ExtractPublicDependencies(c.second);
+    }
+}
+
+void Project::ExtractPublicDependencies(Component& comp) {
+    bool hasExtIncludes = false;
+    for (auto &fp : comp.files) {
+        if (fp->hasExternalInclude) {
+            hasExtIncludes = true;
+            for (auto &dep : fp->dependencies) {
+                comp.privDeps.erase(&dep->component);
+                comp.pubDeps.insert(&dep->component);
             }
         }
-        comp.pubDeps.erase(&comp);
-        comp.privDeps.erase(&comp);
-        comp.type = comp.root.filename().string() == "test" ? "unittest" : (hasExtIncludes || (*comp.root.begin() == "packages")) ? "library" : "executable";
     }
+    comp.pubDeps.erase(&comp);
+    comp.privDeps.erase(&comp);
+    comp.type = comp.root.filename().string() == "test" ? "unittest" : (hasExtIncludes || (*comp.root.begin() == "packages")) ? "library" : "executable";
 }
 
 void Project::ExtractIncludePaths() {
   for (auto &c : components) {
-    Component& comp = c.second;
-    for (auto &fp : comp.files) {
-      if (fp->hasInclude) {
-        (fp->hasExternalInclude ? comp.pubIncl : comp.privIncl).insert(fp->includePaths.begin(),
-                                                                       fp->includePaths.end());
-      }
-    }
-    for (auto &s : comp.pubIncl) {
-      comp.privIncl.erase(s);
-    }
+    ExtractIncludePaths(c.second);
   }
 }
 
-
+void Project::ExtractIncludePaths(Component& comp) {
+  for (auto &fp : comp.files) {
+    if (fp->hasInclude) {
+      (fp->hasExternalInclude ? comp.pubIncl : comp.privIncl).insert(fp->includePaths.begin(),
+                                                                     fp->includePaths.end());
+    }
+  }
+  for (auto &s : comp.pubIncl) {
+    comp.privIncl.erase(s);
+  }
+}
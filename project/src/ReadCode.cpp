@@ -3,6 +3,7 @@
 #include <boost/filesystem.hpp>
 #include "Component.h"
 #include "Configuration.h"
+#include "DirectiveScanner.h"
 #include <fcntl.h>
 #include "File.h"
 #include <sys/mman.h>
@@ -14,10 +15,13 @@ void Project::ReadCodeFrom(File& f, const char* buffer, size_t buffersize) {
     bool pointyBrackets = true;
     bool exported = false;
     enum State { None, AfterHash, AfterSemicolon, AfterImport, AfterModule } state = None;
+    static const DirectiveScanner scanner = GetDirectiveScanner();
     for (size_t offset = 0; offset < buffersize; offset++) {
         switch (state) {
         case None:
         {
+            offset = scanner(buffer + offset, buffer + buffersize) - buffer;
+            if (offset == buffersize) return;
             switch(buffer[offset]) {
             case '#':
                 state = AfterHash;
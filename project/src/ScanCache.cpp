@@ -0,0 +1,147 @@
+#include "ScanCache.h"
+#include "File.h"
+#include "Hash.h"
+#include "Serialize.h"
+#include <boost/filesystem.hpp>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Layout: magic, then records of [u32 body length][u64 checksum of body][body].
+// A body holds the path, size, mtime, module info, includes and imports of one file.
+static const char magic[8] = { 'E', 'V', 'K', 'S', 'C', 'A', 'N', '1' };
+
+ScanCache::~ScanCache() {
+  Unmap();
+}
+
+void ScanCache::Unmap() {
+  records.clear();
+  if (mapping) munmap(const_cast<char*>(mapping), mappingSize);
+  mapping = nullptr;
+  mappingSize = 0;
+}
+
+void ScanCache::Load(const std::string& filename) {
+  Unmap();
+  fresh.clear();
+  hits = misses = 0;
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) return;
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      mapping = static_cast<const char*>(p);
+      mappingSize = st.st_size;
+    }
+  }
+  close(fd);
+  if (!mapping) return;
+
+  if (mappingSize < sizeof(magic) || memcmp(mapping, magic, sizeof(magic)) != 0) {
+    fprintf(stderr, "Scan cache %s has an unknown format, rescanning all files\n", filename.c_str());
+    return;
+  }
+  Reader r{mapping + sizeof(magic), mapping + mappingSize};
+  while (r.p != r.end) {
+    size_t offset = r.p - mapping;
+    uint32_t length = r.Read<uint32_t>();
+    uint64_t checksum = r.Read<uint64_t>();
+    if (!r.ok || static_cast<size_t>(r.end - r.p) < length || Fnv1a(r.p, length) != checksum) {
+      // Anything after a damaged record is unreliable; those files just get rescanned.
+      fprintf(stderr, "Scan cache %s is corrupt at offset %zu, rescanning remaining files\n", filename.c_str(), offset);
+      break;
+    }
+    Reader body{r.p, r.p + length};
+    std::string_view path = body.ReadString();
+    if (body.ok) records[path] = r.p;
+    r.p += length;
+  }
+}
+
+bool ScanCache::Apply(File& f, const std::string& path, uint64_t size, int64_t mtime) const {
+  auto it = records.find(path);
+  if (it == records.end()) return false;
+  const char* body = it->second;
+  uint32_t length;
+  memcpy(&length, body - sizeof(uint64_t) - sizeof(uint32_t), sizeof(length));
+  Reader r{body, body + length};
+  r.ReadString();
+  if (r.Read<uint64_t>() != size || r.Read<int64_t>() != mtime || !r.ok) return false;
+  bool moduleExported = r.Read<uint8_t>() != 0;
+  std::string_view moduleName = r.ReadString();
+  std::unordered_map<Name, bool> rawIncludes;
+  std::unordered_map<std::string, bool> imports;
+  for (uint32_t count = r.Read<uint32_t>(); r.ok && count; count--) {
+    bool pointyBrackets = r.Read<uint8_t>() != 0;
+    std::string_view name = r.ReadString();
+    rawIncludes.emplace(Name(name), pointyBrackets);
+  }
+  for (uint32_t count = r.Read<uint32_t>(); r.ok && count; count--) {
+    bool exported = r.Read<uint8_t>() != 0;
+    std::string_view name = r.ReadString();
+    imports.emplace(std::string(name), exported);
+  }
+  if (!r.ok) return false;
+  f.moduleName = std::string(moduleName);
+  f.moduleExported = moduleExported;
+  f.rawIncludes = std::move(rawIncludes);
+  f.imports = std::move(imports);
+  return true;
+}
+
+void ScanCache::Store(File& f, const std::string& path, uint64_t size, int64_t mtime, bool wasHit) {
+  (wasHit ? hits : misses)++;
+  fresh[path] = Stamp{size, mtime, &f};
+}
+
+void ScanCache::Forget(const std::string& path) {
+  fresh.erase(path);
+}
+
+void ScanCache::Save(const std::string& filename) {
+  std::vector<char> out(magic, magic + sizeof(magic));
+  std::vector<char> body;
+  for (auto& e : fresh) {
+    body.clear();
+    Writer w{body};
+    w.WriteString(e.first);
+    w.Write<uint64_t>(e.second.size);
+    w.Write<int64_t>(e.second.mtime);
+    File& f = *e.second.file;
+    w.Write<uint8_t>(f.moduleExported);
+    w.WriteString(f.moduleName);
+    w.Write<uint32_t>(f.rawIncludes.size());
+    for (auto& i : f.rawIncludes) {
+      w.Write<uint8_t>(i.second);
+      w.WriteString(i.first.str());
+    }
+    w.Write<uint32_t>(f.imports.size());
+    for (auto& i : f.imports) {
+      w.Write<uint8_t>(i.second);
+      w.WriteString(i.first);
+    }
+    Writer o{out};
+    o.Write<uint32_t>(body.size());
+    o.Write<uint64_t>(Fnv1a(body.data(), body.size()));
+    out.insert(out.end(), body.begin(), body.end());
+  }
+
+  boost::system::error_code ec;
+  boost::filesystem::create_directories(boost::filesystem::path(filename).parent_path(), ec);
+  std::string tmpname = filename + ".tmp";
+  FILE* file = fopen(tmpname.c_str(), "wb");
+  if (!file) {
+    fprintf(stderr, "Cannot write scan cache %s\n", tmpname.c_str());
+    return;
+  }
+  bool written = fwrite(out.data(), 1, out.size(), file) == out.size();
+  written = (fclose(file) == 0) && written;
+  if (!written || rename(tmpname.c_str(), filename.c_str()) != 0) {
+    fprintf(stderr, "Cannot write scan cache %s\n", filename.c_str());
+    unlink(tmpname.c_str());
+  }
+}
@@ -5,6 +5,13 @@
 #include "Project.h"
 #include "filter.h"
 
+// Visiting dependencies in a fixed order keeps link lines the same from one run to the next.
+static std::vector<Component*> Sorted(const std::unordered_set<Component*>& deps) {
+  std::vector<Component*> sorted(deps.begin(), deps.end());
+  std::sort(sorted.begin(), sorted.end(), [](Component* a, Component* b) { return a->root < b->root; });
+  return sorted;
+}
+
 template <bool usePrivDepsFromOthers = false>
 struct Tarjan {
   // https://en.wikipedia.org/wiki/Tarjan%27s_strongly_connected_components_algorithm
@@ -22,7 +29,7 @@ struct Tarjan {
   void StrongConnect(Component* c) {
     info[c].index = info[c].lowlink = index++;
     stack.push_back(c);
-    for (auto& c2 : c->pubDeps) {
+    for (auto& c2 : Sorted(c->pubDeps)) {
       if (info[c2].index == 0) {
         StrongConnect(c2);
         info[c].lowlink = std::min(info[c].lowlink, info[c2].lowlink);
@@ -32,7 +39,7 @@ struct Tarjan {
     }
     bool shouldUsePrivDeps = (c == originalComponent) || usePrivDepsFromOthers;
     if (shouldUsePrivDeps) {
-      for (auto& c2 : c->privDeps) {
+      for (auto& c2 : Sorted(c->privDeps)) {
         if (info[c2].index == 0) {
           StrongConnect(c2);
           info[c].lowlink = std::min(info[c].lowlink, info[c2].lowlink);
@@ -72,15 +79,15 @@ std::set<std::string> getIncludePathsFor(Component& component) {
   for (auto& v : pdeps) {
     for (auto& c : v) {
       for (auto& p : c->pubIncl) {
-        inclpaths.insert((c->root / p).string());
+        inclpaths.insert((c->root / p.str()).string());
       }
     }
   }
   for (auto& p : component.pubIncl) {
-    inclpaths.insert((component.root / p).string());
+    inclpaths.insert((component.root / p.str()).string());
   }
   for (auto& p : component.privIncl) {
-    inclpaths.insert((component.root / p).string());
+    inclpaths.insert((component.root / p.str()).string());
   }
   return inclpaths;
 }
@@ -136,7 +136,7 @@ void AndroidToolset::CreateCommandsFor(Project& project, Component& component) {
     for (auto& f : filter(component.files, [&project](File*f){ return project.IsCompilationUnit(f->path.extension().string()); })) {
       boost::filesystem::path outputFile = ("obj/" + p.first) / outputFolder / (f->path.string().substr(component.root.string().size()) + ".o");
       File* of = project.CreateFile(component, outputFile);
-      PendingCommand* pc = new PendingCommand(config.compiler(p.second) + " -c -o " + outputFile.string() + " " + f->path.string() + " " + includes);
+      PendingCommand* pc = project.CreateCommand(config.compiler(p.second) + " -c -o " + outputFile.string() + " " + f->path.string() + " " + includes);
       objects.push_back(of);
       pc->AddOutput(of);
       std::unordered_set<File*> d;
@@ -151,7 +151,6 @@ void AndroidToolset::CreateCommandsFor(Project& project, Component& component) {
           if (d.insert(input).second) deps.push(input);
         index++;
       }
-      pc->Check();
       component.commands.push_back(pc);
     }
     if (!objects.empty()) {
@@ -164,7 +163,7 @@ void AndroidToolset::CreateCommandsFor(Project& project, Component& component) {
         for (auto& file : objects) {
           command += " " + file->path.string();
         }
-        pc = new PendingCommand(command);
+        pc = project.CreateCommand(command);
       } else {
         outputFile = "so/" + p.second.sofoldername + "/" + getSoNameFor(component);
         command = config.linker(p.second) + "-pthread -o " + outputFile.string();
@@ -202,7 +201,7 @@ void AndroidToolset::CreateCommandsFor(Project& project, Component& component) {
             command += " -Wl,--end-group";
           }
         }
-        pc = new PendingCommand(command);
+        pc = project.CreateCommand(command);
         for (auto& d : linkDeps) {
           for (auto& c : d) {
             if (c != &component) {
@@ -217,7 +216,6 @@ void AndroidToolset::CreateCommandsFor(Project& project, Component& component) {
       for (auto& file : objects) {
         pc->AddInput(file);
       }
-      pc->Check();
       component.commands.push_back(pc);
     }
   }
@@ -227,21 +225,19 @@ void AndroidToolset::CreateCommandsFor(Project& project, Component& component) {
 
     // Create apk from manifest & shared libraries
     std::string outputName = component.root.filename().string();
-    PendingCommand* pc = new PendingCommand(config.aapt(outputName, manifest));
+    PendingCommand* pc = project.CreateCommand(config.aapt(outputName, manifest));
     File* uapkfile = project.CreateFile(component, "apk/unsigned_" + outputName + ".apk");
     pc->AddOutput(uapkfile);
     for (auto& file : libraries) {
       pc->AddInput(file);
     }
-    pc->Check();
     component.commands.push_back(pc);
 
     // create signed apk from unsigned apk
-    pc = new PendingCommand(config.apksigner(outputName));
+    pc = project.CreateCommand(config.apksigner(outputName));
     File* apkfile = project.CreateFile(component, "apk/" + outputName + ".apk");
     pc->AddOutput(apkfile);
     pc->AddInput(uapkfile);
-    pc->Check();
     component.commands.push_back(pc);
   }
 }
@@ -26,12 +26,19 @@ void UbuntuToolset::CreateCommandsFor(Project& project, Component& component) {
   // TODO: modules: -fmodules-ts --precompile  -fmodules-cache-path=<directory>-fprebuilt-module-path=<directory>
 
   boost::filesystem::path outputFolder = component.root;
-  std::vector<File*> objects;
+  // Sorted, so the archive and link command lines stay the same from one run to the next.
+  std::vector<File*> units;
   for (auto& f : filter(component.files, [&project](File*f){ return project.IsCompilationUnit(f->path.extension().string()); })) {
+    units.push_back(f);
+  }
+  std::sort(units.begin(), units.end(), [](File* a, File* b) { return a->path < b->path; });
+  std::vector<File*> objects;
+  for (auto& f : units) {
     boost::filesystem::path outputFile = std::string("obj") / outputFolder / (f->path.string().substr(component.root.string().size()) + ".o");
     File* of = project.CreateFile(component, outputFile);
-    PendingCommand* pc = new PendingCommand("g++ -c -std=c++17 -o " + outputFile.string() + " " + f->path.string() + includes);
+    PendingCommand* pc = project.CreateCommand("g++ -c -std=c++17 -o " + outputFile.string() + " " + f->path.string() + includes);
     objects.push_back(of);
+    pc->cacheable = true;
     pc->AddOutput(of);
     std::unordered_set<File*> d;
     std::stack<File*> deps;
@@ -45,7 +52,6 @@ void UbuntuToolset::CreateCommandsFor(Project& project, Component& component) {
         if (d.insert(input).second) deps.push(input);
       index++;
     }
-    pc->Check();
     component.commands.push_back(pc);
   }
   if (!objects.empty()) {
@@ -58,7 +64,7 @@ void UbuntuToolset::CreateCommandsFor(Project& project, Component& component) {
       for (auto& file : objects) {
         command += " " + file->path.string();
       }
-      pc = new PendingCommand(command);
+      pc = project.CreateCommand(command);
     } else {
       outputFile = "bin/" + getExeNameFor(component);
       command = "g++ -pthread -o " + outputFile.string();
@@ -96,7 +102,7 @@ void UbuntuToolset::CreateCommandsFor(Project& project, Component& component) {
           command += " -Wl,--end-group";
         }
       }
-      pc = new PendingCommand(command);
+      pc = project.CreateCommand(command);
       for (auto& d : linkDeps) {
         for (auto& c : d) {
           if (c != &component) {
@@ -110,15 +116,13 @@ void UbuntuToolset::CreateCommandsFor(Project& project, Component& component) {
     for (auto& file : objects) {
       pc->AddInput(file);
     }
-    pc->Check();
     component.commands.push_back(pc);
     if (component.type == "unittest") {
       command = outputFile.string();
-      pc = new PendingCommand(command);
+      pc = project.CreateCommand(command);
       outputFile += ".log";
       pc->AddInput(libraryFile);
       pc->AddOutput(project.CreateFile(component, outputFile.string()));
-      pc->Check();
       component.commands.push_back(pc);
     }
   }